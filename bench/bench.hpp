@@ -0,0 +1,79 @@
+#ifndef BENCH
+#define BENCH
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "memory_network.hpp"
+
+// Helpers shared by the benchmarks. Build them with -DBUILD_BENCHMARKS=ON
+// -DCMAKE_BUILD_TYPE=Release.
+
+/** Mean duration of `phase` per profiled step, in microseconds.
+ */
+inline double phase_mean(const StepProfile& profile, StepPhase phase) {
+    if (profile.steps == 0) return 0;
+    return profile.total[static_cast<size_t>(phase)].count() / 1e3 / profile.steps;
+}
+
+/** Mean duration of the profiled steps, pacing excluded, in microseconds.
+ */
+inline double step_mean(const StepProfile& profile) {
+    double total = 0;
+    for (size_t phase = 0; phase < StepProfile::NB_PHASES; phase++) {
+        if (phase == static_cast<size_t>(StepPhase::Pacing)) continue;
+        total += phase_mean(profile, static_cast<StepPhase>(phase));
+    }
+    return total;
+}
+
+/** Median duration of `repeats` calls of `f`, in microseconds.
+ */
+template<typename F>
+double median_time(size_t repeats, F f) {
+
+    std::vector<double> durations;
+    for (size_t k = 0; k < repeats; k++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        durations.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::sort(durations.begin(), durations.end());
+    return durations[durations.size() / 2];
+}
+
+/** Returns true if `flag` (eg, "--float") is on the command line.
+ */
+inline bool has_flag(int argc, char* argv[], const std::string& flag) {
+    for (int i = 1; i < argc; i++) {
+        if (argv[i] == flag) return true;
+    }
+    return false;
+}
+
+/** Returns the numbers given on the command line (arguments starting with
+ * '-' are options), or `defaults` if there are none.
+ */
+inline std::vector<size_t> arguments(int argc, char* argv[], const std::vector<size_t>& defaults) {
+
+    std::vector<size_t> values;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') values.push_back(std::strtoul(argv[i], nullptr, 10));
+    }
+    return values.empty() ? defaults : values;
+}
+
+/** Names for `n` units.
+ */
+inline std::vector<std::string> unit_names(size_t n, const std::string& prefix = "unit") {
+    std::vector<std::string> names;
+    names.reserve(n);
+    for (size_t i = 0; i < n; i++) names.push_back(prefix + std::to_string(i));
+    return names;
+}
+
+#endif
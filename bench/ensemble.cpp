@@ -0,0 +1,82 @@
+#include <iostream>
+#include <vector>
+
+#include "bench.hpp"
+#include "memory_ensemble.hpp"
+
+// A MemoryEnsemble of B members against B separate MemoryNetwork, in
+// simulated time at 10kHz, with the same stimuli: every 10ms, each member
+// gets 8 of its units stimulated for 5ms.
+//
+// Usage: bench-ensemble [--float] [members...]
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t STIMULATED_UNITS = 8;
+const size_t STEPS = 1000;
+const size_t STIMULATION_PERIOD = 100; // steps
+
+template<typename Scalar>
+void run(size_t nb_members, size_t n) {
+
+    auto names = unit_names(n);
+
+    BasicMemoryEnsemble<Scalar> ensemble(nb_members);
+    ensemble.add_units(names);
+
+    vector<BasicMemoryNetwork<Scalar>> networks(nb_members);
+    for (auto& network : networks) {
+        network.use_physical_time(false);
+        network.max_frequency(10000);
+        network.add_units(names);
+    }
+
+    auto stimulate = [&](size_t t) {
+        for (size_t b = 0; b < nb_members; b++) {
+            for (size_t k = 0; k < STIMULATED_UNITS; k++) {
+                auto id = (b * 7 + (t / STIMULATION_PERIOD) * 3 + k * 13) % n;
+                ensemble.activate_unit(b, id, 1.0, milliseconds(5));
+                networks[b].activate_unit(id, 1.0, milliseconds(5));
+            }
+        }
+    };
+
+    double ensemble_time = 0, networks_time = 0;
+    for (size_t t = 0; t < STEPS; t += STIMULATION_PERIOD) {
+        stimulate(t);
+
+        ensemble_time += median_time(1, [&]() {ensemble.step_n(STIMULATION_PERIOD);});
+        networks_time += median_time(1, [&]() {
+            for (auto& network : networks) network.step_n(STIMULATION_PERIOD);
+        });
+    }
+
+    // the members must behave like the separate networks (up to rounding: the
+    // internal activations are not summed in the same order)
+    double divergence = 0;
+    auto activations = ensemble.activations();
+    for (size_t b = 0; b < nb_members; b++) {
+        divergence = max(divergence, double((activations.col(b) - networks[b].activations()).cwiseAbs().maxCoeff()));
+    }
+
+    cout << "B=" << nb_members << " n=" << n << ": "
+         << "ensemble " << ensemble_time / STEPS << " us/step, "
+         << "separate networks " << networks_time / STEPS << " us/step "
+         << "(x" << networks_time / ensemble_time << "), "
+         << "max difference " << divergence << endl;
+}
+
+int main(int argc, char* argv[]) {
+
+    auto use_float = has_flag(argc, argv, "--float");
+
+    for (auto nb_members : arguments(argc, argv, {64, 128, 256, 512})) {
+        for (size_t n : {50, 200}) {
+            if (use_float) run<float>(nb_members, n);
+            else run<double>(nb_members, n);
+        }
+    }
+
+    return 0;
+}
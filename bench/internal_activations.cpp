@@ -0,0 +1,69 @@
+#include <cmath>
+#include <iostream>
+
+#include "bench.hpp"
+
+// Internal activations of a dense network: the mat-vec product of the
+// network (phase InternalActivations of the step profiler) against the
+// original loop, which skipped the non-connected (NaN) weights one by one.
+//
+// Usage: bench-internal_activations [--float] [sizes...]
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t CONNECTED_UNITS = 100;
+const size_t STEPS = 20;
+
+template<typename Scalar>
+void run(size_t n) {
+
+    typedef BasicMemoryNetwork<Scalar> Network;
+
+    Network network;
+    network.use_physical_time(false);
+    network.max_frequency(1000);
+    network.add_units(unit_names(n));
+
+    // a few units are activated together to create connections (the other
+    // weights stay unconnected)
+    for (size_t i = 0; i < CONNECTED_UNITS; i++) {
+        network.activate_unit(i * (n / CONNECTED_UNITS), 1.0, seconds(10));
+    }
+    network.step_n(5);
+
+    network.profile(true);
+    network.step_n(STEPS);
+    auto matvec = phase_mean(network.step_profile(), StepPhase::InternalActivations);
+
+    auto weights = network.weights();
+    typename Network::Vector activations = network.activations();
+    typename Network::Vector internal_activations(n);
+
+    auto loop = median_time(n > 5000 ? 1 : 5, [&]() {
+        for (size_t i = 0; i < n; i++) {
+            double sum = 0;
+            for (size_t j = 0; j < n; j++) {
+                if (std::isnan(weights(i, j))) continue;
+                sum += weights(i, j) * activations(j);
+            }
+            internal_activations(i) = sum;
+        }
+    });
+
+    cout << n << " units: NaN-skipping loop " << loop / 1e3 << " ms, "
+         << "mat-vec " << matvec / 1e3 << " ms "
+         << "(x" << loop / matvec << ")" << endl;
+}
+
+int main(int argc, char* argv[]) {
+
+    auto use_float = has_flag(argc, argv, "--float");
+
+    for (auto n : arguments(argc, argv, {1000, 5000})) {
+        if (use_float) run<float>(n);
+        else run<double>(n);
+    }
+
+    return 0;
+}
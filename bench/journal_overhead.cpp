@@ -0,0 +1,100 @@
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "bench.hpp"
+
+// Overhead of the weights journal on a live network, stepping at 1 kHz
+// while a few units at a time are stimulated (the weights between them
+// change at each step, and new connections are created when the stimulated
+// units change). The same network runs without, then with the journal: the
+// journal is fed in phase WeightsUpdate of the step profiler, and written
+// by its own thread.
+//
+// Usage: bench-journal_overhead [--float] [seconds]
+
+using namespace std;
+using namespace std::chrono;
+
+const double FREQUENCY = 1000;
+const milliseconds STIMULUS_PERIOD(50);
+
+const string JOURNAL = "bench-journal_overhead.journal";
+
+struct Setup {
+    const char* name;
+    WeightsStorage storage;
+    size_t units;
+};
+
+const Setup SETUPS[] = {
+    {"dense", WeightsStorage::Dense, 2000},
+    {"sparse", WeightsStorage::Sparse, 50000},
+};
+
+const size_t STIMULATED[] = {2, 8};
+
+template<typename Scalar>
+StepProfile run(const Setup& setup, size_t nb_stimulated, seconds duration, bool journal) {
+
+    BasicMemoryNetwork<Scalar> network;
+    network.max_frequency(FREQUENCY);
+    network.weights_storage(setup.storage);
+    network.add_units(unit_names(setup.units));
+    if (journal) network.journal(JOURNAL);
+
+    // the same stimuli with and without the journal
+    mt19937 random(42);
+    uniform_int_distribution<size_t> unit(0, setup.units - 1);
+
+    network.profile(true);
+    network.start();
+
+    auto end = steady_clock::now() + duration;
+    while (steady_clock::now() < end) {
+        for (size_t k = 0; k < nb_stimulated; k++) {
+            network.activate_unit(unit(random), 1.0, STIMULUS_PERIOD);
+        }
+        this_thread::sleep_for(STIMULUS_PERIOD);
+    }
+
+    network.stop();
+    if (journal) {
+        network.stop_journal();
+        remove(JOURNAL.c_str());
+        remove((JOURNAL + ".base").c_str());
+    }
+
+    return network.step_profile();
+}
+
+template<typename Scalar>
+void run(seconds duration) {
+
+    for (const auto& setup : SETUPS) {
+        for (auto nb_stimulated : STIMULATED) {
+
+            auto off = run<Scalar>(setup, nb_stimulated, duration, false);
+            auto on = run<Scalar>(setup, nb_stimulated, duration, true);
+
+            auto weights_off = phase_mean(off, StepPhase::WeightsUpdate);
+            auto weights_on = phase_mean(on, StepPhase::WeightsUpdate);
+
+            cout << setup.name << ", " << setup.units << " units, " << nb_stimulated << " stimulated: "
+                 << "weights update " << weights_off << " us without the journal, "
+                 << weights_on << " us with it (+" << weights_on - weights_off << " us); "
+                 << "whole step " << step_mean(off) << " / " << step_mean(on) << " us" << endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+
+    seconds duration(arguments(argc, argv, {5})[0]);
+
+    if (has_flag(argc, argv, "--float")) run<float>(duration);
+    else run<double>(duration);
+
+    return 0;
+}
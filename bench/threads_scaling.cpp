@@ -0,0 +1,66 @@
+#include <iostream>
+#include <thread>
+
+#include "bench.hpp"
+
+// Step time of a dense network against the number of threads of its worker
+// pool (see `BasicMemoryNetwork::threads`), from 1 to the number of hardware
+// threads (or the thread counts given on the command line).
+//
+// Usage: bench-threads_scaling [--float] [--units=N] [thread counts...]
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t CONNECTED_UNITS = 200;
+const size_t STEPS = 200;
+
+template<typename Scalar>
+double step_time(size_t n, size_t nb_threads) {
+
+    BasicMemoryNetwork<Scalar> network;
+    network.use_physical_time(false);
+    network.max_frequency(10000);
+    network.threads(nb_threads);
+    network.add_units(unit_names(n));
+
+    // a connected core keeps many units active (and learning)
+    for (size_t i = 0; i < CONNECTED_UNITS; i++) {
+        network.activate_unit(i * (n / CONNECTED_UNITS), 1.0, seconds(10));
+    }
+    network.step_n(10);
+
+    return median_time(5, [&]() {network.step_n(STEPS);}) / STEPS;
+}
+
+template<typename Scalar>
+void run(size_t n, const vector<size_t>& thread_counts) {
+
+    double reference = 0;
+    for (auto nb_threads : thread_counts) {
+        auto time = step_time<Scalar>(n, nb_threads);
+        if (reference == 0) reference = time;
+
+        cout << n << " units, " << nb_threads << " thread(s): "
+             << time << " us/step (speedup x" << reference / time << ")" << endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+
+    size_t n = 4000;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, 8, "--units=") == 0) n = stoul(arg.substr(8));
+    }
+
+    vector<size_t> thread_counts;
+    for (size_t t = 1; t <= max(1u, thread::hardware_concurrency()); t *= 2) thread_counts.push_back(t);
+
+    cout << thread::hardware_concurrency() << " hardware thread(s)" << endl;
+
+    if (has_flag(argc, argv, "--float")) run<float>(n, arguments(argc, argv, thread_counts));
+    else run<double>(n, arguments(argc, argv, thread_counts));
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include <iostream>
+
+#include "bench.hpp"
+
+// Cost of a step as unrelated units are added: with sparse storage, 8
+// units are stimulated every 100 steps, the others are never stimulated.
+// The connections and the learning only depend on the stimulated units, so
+// the step time should stay flat.
+//
+// Usage: bench-unrelated_units [sizes...]
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t STIMULATED_UNITS = 8;
+const size_t STEPS = 10000;
+
+int main(int argc, char* argv[]) {
+
+    for (auto n : arguments(argc, argv, {1000, 10000, 100000, 1000000})) {
+
+        MemoryNetwork network;
+        network.weights_storage(WeightsStorage::Sparse);
+        network.use_physical_time(false);
+        network.max_frequency(10000);
+        network.add_units(unit_names(n));
+        network.step_n();
+
+        network.profile(true);
+        for (size_t t = 0; t < STEPS; t += 100) {
+            for (size_t k = 0; k < STIMULATED_UNITS; k++) {
+                network.activate_unit(k, 1.0, milliseconds(5));
+            }
+            network.step_n(100);
+        }
+
+        auto profile = network.step_profile();
+        cout << n << " units: " << step_mean(profile) << " us/step "
+             << "(connections " << phase_mean(profile, StepPhase::Connections) << " us, "
+             << "weights update " << phase_mean(profile, StepPhase::WeightsUpdate) << " us)" << endl;
+    }
+
+    return 0;
+}
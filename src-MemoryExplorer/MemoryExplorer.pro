@@ -21,11 +21,33 @@ SOURCES += main.cpp\
         mainwindow.cpp \
     qcustomplot.cpp \
     ../src/memory_network.cpp \
+    ../src/activation_intervals.cpp \
+    ../src/activations_history.cpp \
+    ../src/activations_recorder.cpp \
+    ../src/activations_sink.cpp \
+    ../src/mapped_file.cpp \
+    ../src/tracer.cpp \
+    ../src/unit_registry.cpp \
+    ../src/weights_journal.cpp \
+    ../src/worker_pool.cpp \
     ../src-runner/experiment.cpp
 
 HEADERS  += mainwindow.h \
     qcustomplot.h \
     ../src/memory_network.hpp \
+    ../src/activation_intervals.hpp \
+    ../src/activations_history.hpp \
+    ../src/activations_recorder.hpp \
+    ../src/activations_sink.hpp \
+    ../src/decimator.hpp \
+    ../src/mapped_file.hpp \
+    ../src/mpsc_queue.hpp \
+    ../src/spsc_ring.hpp \
+    ../src/timer_wheel.hpp \
+    ../src/tracer.hpp \
+    ../src/unit_registry.hpp \
+    ../src/weights_journal.hpp \
+    ../src/worker_pool.hpp \
     ../src-runner/parser.hpp \
     ../src-runner/experiment.hpp
 
@@ -5,6 +5,7 @@
 #include <map>
 #include <vector>
 #include <functional>
+#include <numeric>
 
 #include <QMessageBox>
 #include <QFileInfo>
@@ -37,27 +38,23 @@ const QColor fillColor = QColor(200,200,200,20);
 
 const int HISTORY_SAMPLING_RATE = 500;  // Hz
 
-vector<double> activations_timestamps;
-vector<double> external_activations_timestamps;
-map<size_t, vector<double>> activations_logs;
-map<size_t, vector<double>> external_activations_logs;
-
-microseconds _last_activations_log;
-microseconds _last_external_activations_log;
-
-void logging(map<size_t, vector<double>> &logs, vector<double> &timestamps,
-             microseconds &last_log, microseconds time_from_start,
-             const MemoryVector &levels) {
-    // if necessary, store the activation level
-    microseconds us_since_last_log = time_from_start - last_log;
-    if (us_since_last_log.count() >
-        (std::micro::den * 1. / HISTORY_SAMPLING_RATE)) {
-        last_log = time_from_start;
-        timestamps.push_back(
-            duration_cast<milliseconds>(time_from_start).count());
-        for (size_t i = 0; i < levels.size(); i++) {
-            logs[i].push_back(levels[i]);
-        }
+// sets the data of the graphs [first_graph, first_graph + nb units) to the
+// history of each unit
+void plotHistory(QCustomPlot *plot, int first_graph,
+                 const ActivationsHistory &history) {
+
+    vector<microseconds> times;
+    vector<double> levels;
+
+    for (auto id : history.units()) {
+        history.read(id, times, levels);
+
+        QVector<double> timestamps;
+        timestamps.reserve(times.size());
+        for (auto time : times) timestamps.push_back(time.count() / 1000.);
+
+        plot->graph(first_graph + id)
+            ->setData(timestamps, QVector<double>::fromStdVector(levels));
     }
 }
 
@@ -386,21 +383,9 @@ void MainWindow::prepareActivationsPlot() {
 
 void MainWindow::updateActivationsPlot() {
 
-    auto qTimestamps = QVector<double>::fromStdVector(activations_timestamps);
-
-    for (const auto &kv : activations_logs) {
-        auto data = QVector<double>::fromStdVector(kv.second);
-        ui->activationPlot->graph(kv.first)
-                          ->setData(qTimestamps, data);
-    }
-
-    auto qExternalTimestamps = QVector<double>::fromStdVector(external_activations_timestamps);
-
-    for (const auto &kv : external_activations_logs) {
-        auto data = QVector<double>::fromStdVector(kv.second);
-        ui->activationPlot->graph(kv.first + external_activations_logs.size())
-                          ->setData(qExternalTimestamps, data);
-    }
+    plotHistory(ui->activationPlot, 0, *activations_history);
+    plotHistory(ui->activationPlot, activations_history->units().size(),
+                *external_activations_history);
 
     ui->activationPlot->replot();
 }
@@ -524,73 +509,55 @@ void MainWindow::on_runButton_clicked() {
     ui->runButton->setDisabled(true);
 
     // reset logs
-    activations_logs.clear();
-    activations_timestamps.clear();
-    external_activations_logs.clear();
-    external_activations_timestamps.clear();
-
-    _last_activations_log = microseconds(0);
-    _last_external_activations_log = microseconds(0);
+    activations_history->clear();
+    external_activations_history->clear();
 
     memory->reset();
-
-    memory->start();
+    auto dropped_activations = memory->dropped_activations();
+
+    // the activations are scheduled upfront (directly in the network's
+    // timers, not through its bounded activations queue), and applied by the
+    // network itself at the right time
+    for (const auto &kv : expe.activations) {
+
+        for (auto &activation : kv.second) {
+            string name;
+            float level;
+            chrono::milliseconds duration;
+            tie(name, level, duration) = activation;
+
+            cerr << "    - Activating " << name <<
+                 " at level " << level <<
+                "	 for " << duration.count() << "ms" <<
+                " at " << kv.first << "ms" << endl;
+            memory->schedule_activation(name, level, duration, milliseconds(kv.first));
+        }
+    }
 
     if(memory->is_using_physical_time())
     {
-
-        int last_activation = 0;
-        auto start = high_resolution_clock::now();
-
-        for (const auto &kv : expe.activations) {
-            this_thread::sleep_for(milliseconds(kv.first - last_activation));
-
-            for (auto &activation : kv.second) {
-                string name;
-                float level;
-                chrono::milliseconds duration;
-                tie(name, level, duration) = activation;
-
-                cerr << "    - Activating " << name <<
-                     " at level " << level <<
-                    "	 for " << duration.count() << "ms" << endl;
-                memory->activate_unit(name, level, duration);
-            }
-
-            last_activation = kv.first;
-        }
-        auto remaining_time =
-            expe.duration - (high_resolution_clock::now() - start);
-        this_thread::sleep_for(remaining_time);
+        memory->start();
+        this_thread::sleep_for(expe.duration);
     }
     else
     {
-        for (const auto &kv : expe.activations) {
-
-            while(memory->elapsed_time() < milliseconds(kv.first)) {
-                this_thread::sleep_for(microseconds(1));
-            }
-            for (auto &activation : kv.second) {
-                string name;
-                float level;
-                chrono::milliseconds duration;
-                tie(name, level, duration) = activation;
-
-                memory->activate_unit(name, level, duration);
-            }
-        }
-
-        while(memory->elapsed_time() < expe.duration) {
-            this_thread::sleep_for(milliseconds(1));
-        }
+        // simulated time: step the network synchronously, as fast as possible
+        memory->run_for(expe.duration);
     }
 
-    memory->stop();
     cerr << endl
          << "EXPERIMENT COMPLETED. Total duration: "
          << duration_cast<std::chrono::milliseconds>(
                 memory->elapsed_time()).count() << "ms" << endl;
 
+    if(memory->isrunning()) memory->stop();
+
+    if(memory->dropped_activations() > dropped_activations) {
+        QMessageBox::critical(this, "Activations dropped",
+                              QString::number(memory->dropped_activations() - dropped_activations) +
+                              " activations were dropped: the results are incomplete!");
+    }
+
     statusBar()->showMessage("Experiment completed!", 2000);
 
     updateActivationsPlot();
@@ -647,19 +614,7 @@ void MainWindow::loadExperiment(const QString &filename) {
 void MainWindow::setupExperiment(const Experiment &_expe) {
     expe = _expe;
 
-    auto activations_logging =
-        std::bind(logging, ref(activations_logs), ref(activations_timestamps),
-                  ref(_last_activations_log), std::placeholders::_1,
-                  std::placeholders::_2);
-
-    auto external_activations_logging =
-        std::bind(logging, ref(external_activations_logs),
-                  ref(external_activations_timestamps),
-                  ref(_last_external_activations_log), std::placeholders::_1,
-                  std::placeholders::_2);
-
-    memory = make_unique<MemoryNetwork>(activations_logging,
-                                        external_activations_logging);
+    memory = make_unique<MemoryNetwork>();
 
     memory->use_physical_time(!ui->simulated_time_checkbox->isChecked());
 
@@ -667,6 +622,17 @@ void MainWindow::setupExperiment(const Experiment &_expe) {
         memory->add_unit(unit);
     }
 
+    // the whole experiment is kept, for all the units
+    vector<size_t> units(expe.units.size());
+    iota(units.begin(), units.end(), 0);
+    auto nb_samples = duration_cast<microseconds>(expe.duration).count()
+                      * HISTORY_SAMPLING_RATE / std::micro::den + 1;
+
+    activations_history = make_shared<ActivationsHistory>(units, nb_samples, HISTORY_SAMPLING_RATE);
+    external_activations_history = make_shared<ActivationsHistory>(units, nb_samples, HISTORY_SAMPLING_RATE);
+    memory->log_history(activations_history);
+    memory->log_external_history(external_activations_history);
+
     set_param("Dg")
     set_ui_param(Dg, "Decay")
     set_param("Lg")
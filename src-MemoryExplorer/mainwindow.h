@@ -106,6 +106,10 @@ private:
 
     std::unique_ptr<MemoryNetwork> memory;
 
+    // recorded by the network, for all the units
+    std::shared_ptr<ActivationsHistory> activations_history;
+    std::shared_ptr<ActivationsHistory> external_activations_history;
+
     Experiment expe;
     void saveFile(const QString &fileName);
 
@@ -16,26 +16,6 @@ using namespace std;
 using namespace std::chrono;
 namespace po = boost::program_options;
 
-map<size_t, vector<double>> logs;
-
-microseconds _last_log;
-
-void logging(microseconds time_from_start,
-             const MemoryVector& levels)
-{
-
-    // if necessary, store the activation level
-    auto us_since_last_log = time_from_start - _last_log;
-    if(us_since_last_log.count() > (1000000./HISTORY_SAMPLING_RATE)) {
-        _last_log = time_from_start;
-        for(size_t i = 0; i < levels.size(); i++) {
-            logs[i].push_back(levels[i]);
-        }
-    }
-
-
-}
-
 int main(int argc, char *argv[]) {
 
     po::positional_options_description p;
@@ -97,11 +77,21 @@ int main(int argc, char *argv[]) {
     cerr << "-------------------------------------------------" << endl << endl;
     auto& expe = experiment_parser.expe;
 
-    MemoryNetwork memory(&logging);
+    MemoryNetwork memory;
+
     for (const auto& unit : expe.units) {
         memory.add_unit(unit);
     }
 
+    // only the plotted units are recorded, for the whole experiment
+    vector<size_t> plotted_units;
+    for (const auto& kv : expe.plots) {
+        plotted_units.push_back(memory.unit_id(kv.first));
+    }
+    auto nb_samples = duration_cast<microseconds>(expe.duration).count() * HISTORY_SAMPLING_RATE / std::micro::den + 1;
+    auto history = make_shared<ActivationsHistory>(plotted_units, nb_samples, HISTORY_SAMPLING_RATE);
+    memory.log_history(history);
+
     if (expe.parameters.count("MaxFreq")) {
         memory.max_frequency(expe.parameters["MaxFreq"]);
     }
@@ -121,13 +111,10 @@ int main(int argc, char *argv[]) {
     cerr <<         "        Running the experiment                   " << endl;
     cerr <<         "-------------------------------------------------" << endl << endl;
 
-    memory.start();
-
-    int last_activation = 0;
-    auto start = high_resolution_clock::now();
-    
+    // the activations are scheduled upfront (directly in the network's
+    // timers, not through its bounded activations queue), and applied by the
+    // network itself at the right time
     for (const auto& kv : expe.activations) {
-        this_thread::sleep_for(milliseconds(kv.first - last_activation));
 
         for (auto& activation : kv.second) {
             string name;
@@ -137,18 +124,24 @@ int main(int argc, char *argv[]) {
 
             cerr << "    - Activating " << name << 
                            " at level " << level << 
-                                " for " << duration.count() << "ms" << endl;
-            memory.activate_unit(name, level, duration);
+                                " for " << duration.count() << "ms" <<
+                                " at " << kv.first << "ms" << endl;
+            memory.schedule_activation(name, level, duration, milliseconds(kv.first));
         }
-
-        last_activation = kv.first;
     }
 
-    auto remaining_time = expe.duration - (high_resolution_clock::now() - start);
-    this_thread::sleep_for(remaining_time);
+    auto start = high_resolution_clock::now();
+    memory.start();
+
+    this_thread::sleep_for(expe.duration);
 
     memory.stop();
 
+    if (memory.dropped_activations() > 0) {
+        cerr << "Experiment failed: " << memory.dropped_activations() << " activations were dropped!" << endl;
+        return 1;
+    }
+
     cerr << endl << "EXPERIMENT COMPLETED. Total duration: " << duration_cast<std::chrono::milliseconds>(high_resolution_clock::now() - start).count() << "ms" << endl;
 
     cerr << endl << "-------------------------------------------------" << endl;
@@ -179,22 +172,28 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    vector<microseconds> times;
+    vector<double> levels;
+
     size_t plot_idx = 0;
     for (auto& kv : expe.plots) {
         header.push_back(kv.first);
         size_t id = memory.unit_id(kv.first);
         cerr << "  - for " << kv.first << ": " << endl;
 
+        history->read(id, times, levels);
+
         for (auto& period : kv.second) {
 
             cerr << "    - from " << period.start << "ms to " << period.stop << "ms" << endl;
 
 
             for (size_t idx = double(period.start) / (1000./HISTORY_SAMPLING_RATE);
-                    idx < double(period.stop) / (1000./HISTORY_SAMPLING_RATE);
+                    idx < double(period.stop) / (1000./HISTORY_SAMPLING_RATE)
+                    && idx < levels.size() && idx < data.size();
                     idx++)
             {
-                data[idx][plot_idx + 1] = logs[id][idx];
+                data[idx][plot_idx + 1] = levels[idx];
             }
         }
 
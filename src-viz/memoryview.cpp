@@ -16,11 +16,12 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <string>
+#include <numeric>
 
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/predicate.hpp>
-#include <boost/circular_buffer.hpp>
 
 #include <json/json.h>
 
@@ -39,34 +40,12 @@ using namespace std::chrono_literals;
 
 const int HISTORY_SAMPLING_RATE = 500;  // Hz
 const int HISTORY_LENGTH = 1000;  //samples
-
-map<size_t, boost::circular_buffer<double>> activations_logs;
-
-microseconds last_activations_log;
-
-void logging(microseconds time_from_start, const MemoryVector &levels) {
-
-    // at first call, initialize the circular buffers and set their capacity.
-    if (activations_logs.size() != levels.size()) {
-        for (size_t i=0; i < levels.size(); i++) {
-            activations_logs[i].set_capacity(HISTORY_LENGTH);
-        }
-    }
-
-    // if necessary, store the activation level
-    microseconds us_since_last_log = time_from_start - last_activations_log;
-    if (us_since_last_log.count() > (std::micro::den * 1. / HISTORY_SAMPLING_RATE)) {
-        last_activations_log = time_from_start;
-        for (size_t i = 0; i < levels.size(); i++) {
-            activations_logs[i].push_back(levels[i]);
-        }
-    }
-}
+const int HISTORY_UNITS = 256; // initially; doubled as units are added
 
 MemoryView::MemoryView(const Json::Value& config, 
                        double decay_rate, double learning_rate):
     config(config),
-    memory(logging, nullptr, decay_rate, learning_rate),
+    memory(nullptr, nullptr, decay_rate, learning_rate),
     display_shadows(config.get("shadows", true).asBool()),
     display_labels(config.get("display_labels", true).asBool()),
     display_footer(config.get("display_footer", false).asBool())
@@ -76,6 +55,11 @@ MemoryView::MemoryView(const Json::Value& config,
         memory.add_unit(string("input") + to_string(i));
     }
 
+    vector<size_t> units(HISTORY_UNITS);
+    iota(units.begin(), units.end(), 0);
+    activations_history = make_shared<ActivationsHistory>(units, HISTORY_LENGTH, HISTORY_SAMPLING_RATE);
+    memory.log_history(activations_history);
+
     time_scale = 1.0f;
     runtime = 0.0f;
     framecount = 0;
@@ -193,6 +177,7 @@ void MemoryView::init(){
     TRACE("*** Initialization ***");
 
     memory.record(true);
+    memory.publish_snapshots(true);
     memory.start();
 
     TRACE("*** Graph created and populated ***");
@@ -249,7 +234,16 @@ void MemoryView::keyPress(SDL_KeyboardEvent *e) {
         }
 
         if(e->keysym.sym == SDLK_a) {
-            memory.add_unit(string("input") + to_string(memory.size()));
+            auto id = memory.add_unit(string("input") + to_string(memory.size()));
+
+            // the history covers a fixed set of units: switch to a larger
+            // one (starting empty) when the network outgrows it
+            if (!activations_history->has_unit(id)) {
+                vector<size_t> units(max(2 * activations_history->units().size(), id + 1));
+                iota(units.begin(), units.end(), 0);
+                activations_history = make_shared<ActivationsHistory>(units, HISTORY_LENGTH, HISTORY_SAMPLING_RATE);
+                memory.log_history(activations_history);
+            }
         }
     }
 }
@@ -532,7 +526,11 @@ void MemoryView::drawNodeDetails(Node* node, int offset, bool highlight) {
 
         // graph itself
         glColor4f(1.f, .2f, 0.2f, 1.f);
-        auto history = activations_logs[node->getID()];
+        vector<double> history;
+        if (activations_history->has_unit(node->getID())) {
+            vector<microseconds> times;
+            activations_history->read(node->getID(), times, history);
+        }
 
         glBegin(GL_LINE_STRIP);
         for(int i=0;i<history.size();i++) {
@@ -883,15 +881,16 @@ void MemoryView::addSelectedNode(Node* node) {
     }
 }
 
-void MemoryView::initFromMemoryNetwork() {
+void MemoryView::initFromMemoryNetwork(size_t size) {
 
+    auto names = memory.units_names();
 
-    for (size_t i = 0; i < memory.size(); i++) {
-        Node& n = g.addNode(i, memory.units_names()[i]);
+    for (size_t i = 0; i < size; i++) {
+        Node& n = g.addNode(i, names[i]);
     }
 
-    for (size_t i = 0; i < memory.size()-1; i++) {
-        for (size_t j = i+1; j < memory.size(); j++) {
+    for (size_t i = 0; i < size-1; i++) {
+        for (size_t j = i+1; j < size; j++) {
 
             auto& n1 = g.getNode(i);
             auto& n2 = g.getNode(j);
@@ -903,14 +902,19 @@ void MemoryView::initFromMemoryNetwork() {
 
 void MemoryView::updateFromMemoryNetwork(const MemoryNetwork& memory) {
 
-    if (memory.size() > g.nodesCount()) initFromMemoryNetwork();
+    // read the latest published state of the network: no copy, and
+    // consistent even though the network keeps running
+    auto snapshot = memory.snapshot();
+    if (!snapshot) return;
+
+    if (snapshot->size() > g.nodesCount()) initFromMemoryNetwork(snapshot->size());
 
-    for (size_t i = 0; i < memory.size(); i++) {
-        g.getNode(i).activity = memory.activations()(i);
+    for (size_t i = 0; i < snapshot->size(); i++) {
+        g.getNode(i).activity = snapshot->activations(i);
     }
 
     for (auto& edge : *g.getEdges()) {
-        edge.setWeight(memory.weights()(edge.getId1(),edge.getId2()));
+        edge.setWeight(snapshot->weight(edge.getId1(),edge.getId2()));
     }
 
 
@@ -50,6 +50,7 @@ class MemoryView : public SDLApp {
 
     // Memory network
     MemoryNetwork memory;
+    std::shared_ptr<ActivationsHistory> activations_history;
 
     //Time
     time_t currtime;
@@ -194,7 +195,7 @@ public:
     static void drawVector(vec2f vec, vec2f pos, vec4f col);
 
 
-    void initFromMemoryNetwork();
+    void initFromMemoryNetwork(size_t size);
     void updateFromMemoryNetwork(const MemoryNetwork& memory);
 
     Node& getNode(int id);
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "activation_intervals.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// units whose interval spans more buckets than this are not listed in the
+// buckets (they are always considered by the queries)
+const int64_t MAX_INTERVAL_BUCKETS = 1024;
+
+ActivationIntervals::ActivationIntervals(microseconds bucket_width) :
+                _bucket_width(bucket_width.count())
+{
+    if (_bucket_width <= 0) {
+        throw runtime_error("The buckets of the activations history must have a positive width.");
+    }
+}
+
+void ActivationIntervals::add(size_t id, float level, microseconds time, microseconds duration) {
+
+    auto start = time.count();
+
+    // the network was restarted: continue from the last time recorded
+    if (start + _offset < _last_time) _offset = _last_time - start;
+    start += _offset;
+    _last_time = start;
+
+    auto end = start + max(duration.count(), int64_t(0));
+
+    if (id >= _intervals.size()) {
+        _intervals.resize(id + 1);
+        _last_bucket.resize(id + 1, -1);
+        _is_long.resize(id + 1, false);
+    }
+    auto& intervals = _intervals[id];
+
+    // the new activation replaces the current one, if any
+    if (!intervals.empty() && intervals.back().end >= start) {
+        auto& last = intervals.back();
+
+        if (last.level == level && end > start) { // same levels: merge!
+            last.end = end;
+            index(id, last.start, end);
+            return;
+        }
+
+        last.end = start;
+        if (last.end == last.start) {
+            intervals.pop_back();
+            _size--;
+        }
+    }
+
+    if (end > start) {
+        intervals.push_back({start, end, level});
+        _size++;
+        index(id, start, end);
+    }
+}
+
+void ActivationIntervals::clear() {
+
+    _intervals.clear();
+    _last_bucket.clear();
+    _size = 0;
+
+    _buckets.clear();
+    _long_units.clear();
+    _is_long.clear();
+
+    _offset = 0;
+    _last_time = numeric_limits<int64_t>::min();
+}
+
+int64_t ActivationIntervals::bucket(int64_t time) const {
+    return max(time, int64_t(0)) / _bucket_width;
+}
+
+void ActivationIntervals::index(size_t id, int64_t start, int64_t end) {
+
+    if (_is_long[id]) return;
+
+    // the buckets already listing the unit are skipped
+    auto first = max(bucket(start), _last_bucket[id] + 1);
+    auto last = bucket(end - 1);
+    if (first > last) return;
+
+    if (last - first >= MAX_INTERVAL_BUCKETS) {
+        _is_long[id] = true;
+        _long_units.push_back(id);
+        return;
+    }
+
+    if (_buckets.size() <= size_t(last)) _buckets.resize(last + 1);
+    for (auto b = first; b <= last; b++) _buckets[b].push_back(id);
+    _last_bucket[id] = last;
+}
+
+void ActivationIntervals::candidates(int64_t begin, int64_t end, vector<size_t>& units) const {
+
+    if (!_buckets.empty()) {
+        auto first = bucket(begin);
+        auto last = min(bucket(end - 1), int64_t(_buckets.size()) - 1);
+        for (auto b = first; b <= last; b++) {
+            units.insert(units.end(), _buckets[b].begin(), _buckets[b].end());
+        }
+    }
+    units.insert(units.end(), _long_units.begin(), _long_units.end());
+}
+
+vector<ActivationIntervals::Interval>::const_iterator
+ActivationIntervals::first_ending_after(const vector<Interval>& intervals, int64_t time) {
+
+    // the intervals of a unit do not overlap: they are sorted by end as well
+    return partition_point(intervals.begin(), intervals.end(),
+                           [time](const Interval& interval) {return interval.end <= time;});
+}
+
+vector<ActivationInterval> ActivationIntervals::intervals(size_t id,
+                                                          microseconds begin,
+                                                          microseconds end) const {
+    vector<ActivationInterval> result;
+    if (id >= _intervals.size() || begin >= end) return result;
+
+    const auto& intervals = _intervals[id];
+    for (auto it = first_ending_after(intervals, begin.count());
+         it != intervals.end() && it->start < end.count();
+         ++it) {
+        result.push_back({id, it->level, microseconds(it->start), microseconds(it->end)});
+    }
+
+    return result;
+}
+
+float ActivationIntervals::level(size_t id, microseconds time) const {
+
+    if (id >= _intervals.size()) return 0;
+
+    const auto& intervals = _intervals[id];
+    auto it = first_ending_after(intervals, time.count());
+    if (it == intervals.end() || it->start > time.count()) return 0;
+
+    return it->level;
+}
+
+vector<size_t> ActivationIntervals::active_units(microseconds begin, microseconds end) const {
+
+    vector<size_t> units;
+    if (begin >= end) return units;
+
+    candidates(begin.count(), end.count(), units);
+    sort(units.begin(), units.end());
+    units.erase(unique(units.begin(), units.end()), units.end());
+
+    units.erase(remove_if(units.begin(), units.end(), [this, begin, end](size_t id) {
+                    const auto& intervals = _intervals[id];
+                    auto it = first_ending_after(intervals, begin.count());
+                    return it == intervals.end() || it->start >= end.count();
+                }),
+                units.end());
+
+    return units;
+}
+
+vector<pair<size_t, microseconds>> ActivationIntervals::co_occurrences(size_t id,
+                                                                        microseconds begin,
+                                                                        microseconds end) const {
+    vector<pair<size_t, microseconds>> result;
+    if (id >= _intervals.size() || begin >= end) return result;
+
+    unordered_map<size_t, int64_t> overlaps;
+    vector<size_t> units;
+
+    const auto& intervals = _intervals[id];
+    for (auto it = first_ending_after(intervals, begin.count());
+         it != intervals.end() && it->start < end.count();
+         ++it) {
+
+        auto start = max(it->start, int64_t(begin.count()));
+        auto stop = min(it->end, int64_t(end.count()));
+
+        units.clear();
+        candidates(start, stop, units);
+        sort(units.begin(), units.end());
+        units.erase(unique(units.begin(), units.end()), units.end());
+
+        for (auto other : units) {
+            if (other == id) continue;
+
+            const auto& others = _intervals[other];
+            for (auto jt = first_ending_after(others, start);
+                 jt != others.end() && jt->start < stop;
+                 ++jt) {
+                overlaps[other] += min(jt->end, stop) - max(jt->start, start);
+            }
+        }
+    }
+
+    for (const auto& overlap : overlaps) {
+        result.emplace_back(overlap.first, microseconds(overlap.second));
+    }
+    sort(result.begin(), result.end(), [](const pair<size_t, microseconds>& a,
+                                          const pair<size_t, microseconds>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+
+    return result;
+}
@@ -0,0 +1,129 @@
+#ifndef ACTIVATION_INTERVALS
+#define ACTIVATION_INTERVALS
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/** An interval of time during which a unit had a given external
+ * activation: [start, end).
+ */
+struct ActivationInterval {
+    size_t id;
+    float level;
+    std::chrono::microseconds start;
+    std::chrono::microseconds end;
+};
+
+/** The history of the external activations of the units, as intervals of
+ * constant level, indexed by time.
+ *
+ * Each unit has its own sorted list of (non-overlapping) intervals, for
+ * O(log n) point and range queries on a unit. Besides, the time is divided
+ * in buckets of `bucket_width`, each listing the units that were active
+ * during it, so that the units active over a range of time are found
+ * without scanning the whole history.
+ *
+ * Activations must be added in chronological order (as the network applies
+ * them). As the network time restarts at 0 when the network is restarted,
+ * the times of a run are shifted to follow the end of the previous one.
+ *
+ * Not thread-safe.
+ */
+class ActivationIntervals
+{
+
+public:
+
+    explicit ActivationIntervals(std::chrono::microseconds bucket_width = std::chrono::seconds(1));
+
+    /** Records that unit `id` gets an external activation of `level` at
+     * `time`, for `duration`. Like in the network, it replaces the current
+     * external activation of the unit, if any: an interval of the same level
+     * is extended (or shortened) to end with the new one.
+     */
+    void add(size_t id, float level,
+             std::chrono::microseconds time,
+             std::chrono::microseconds duration);
+
+    /** Removes all the intervals.
+     */
+    void clear();
+
+    /** Number of units that have (had) an external activation: 1 + highest ID.
+     */
+    size_t nb_units() const {return _intervals.size();}
+
+    /** Number of intervals recorded.
+     */
+    size_t size() const {return _size;}
+
+    /** Returns the intervals of unit `id` overlapping [begin, end), in
+     * chronological order.
+     */
+    std::vector<ActivationInterval> intervals(size_t id,
+                                              std::chrono::microseconds begin = std::chrono::microseconds::min(),
+                                              std::chrono::microseconds end = std::chrono::microseconds::max()) const;
+
+    /** Returns the external activation of unit `id` at `time` (0 if none).
+     */
+    float level(size_t id, std::chrono::microseconds time) const;
+
+    /** Returns the (sorted) IDs of the units that had an external activation
+     * at some point in [begin, end).
+     */
+    std::vector<size_t> active_units(std::chrono::microseconds begin,
+                                     std::chrono::microseconds end) const;
+
+    /** Returns the units that had an external activation at the same time as
+     * unit `id`, within [begin, end), with how long they did, longest first.
+     */
+    std::vector<std::pair<size_t, std::chrono::microseconds>>
+    co_occurrences(size_t id,
+                   std::chrono::microseconds begin = std::chrono::microseconds::min(),
+                   std::chrono::microseconds end = std::chrono::microseconds::max()) const;
+
+private:
+
+    struct Interval {
+        int64_t start;
+        int64_t end;
+        float level;
+    };
+
+    int64_t _bucket_width;
+
+    // by unit ID
+    std::vector<std::vector<Interval>> _intervals;
+    std::vector<int64_t> _last_bucket; // last bucket listing the unit, -1 if none
+    size_t _size = 0;
+
+    // by bucket: the units active during the bucket. Units whose interval
+    // spans too many buckets are listed in `_long_units` instead.
+    std::vector<std::vector<uint32_t>> _buckets;
+    std::vector<uint32_t> _long_units;
+    std::vector<bool> _is_long;
+
+    // shift of the times, after a restart of the network
+    int64_t _offset = 0;
+    int64_t _last_time = std::numeric_limits<int64_t>::min();
+
+    int64_t bucket(int64_t time) const;
+
+    void index(size_t id, int64_t start, int64_t end);
+
+    /** Appends to `units` the units that may have been active in
+     * [begin, end) (possibly several times).
+     */
+    void candidates(int64_t begin, int64_t end, std::vector<size_t>& units) const;
+
+    /** First interval of `intervals` ending after `time`.
+     */
+    static std::vector<Interval>::const_iterator first_ending_after(const std::vector<Interval>& intervals,
+                                                                    int64_t time);
+};
+
+#endif
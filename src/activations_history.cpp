@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "activations_history.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t npos = numeric_limits<size_t>::max();
+
+template<typename Scalar>
+BasicActivationsHistory<Scalar>::BasicActivationsHistory(const vector<size_t>& units,
+                                                         size_t capacity,
+                                                         double sampling_rate) :
+                _units(units),
+                _sampling_rate(sampling_rate),
+                _decimator(sampling_rate)
+{
+    if (sampling_rate < 0) {
+        throw runtime_error("The sampling rate of an activations history can not be negative.");
+    }
+
+    // one more slot than requested: the slot of the oldest sample is the
+    // one the producer overwrites next, and is never read
+    size_t size = 1;
+    while (size < capacity + 1) size <<= 1;
+    _mask = size - 1;
+
+    for (size_t column = 0; column < _units.size(); column++) {
+        auto id = _units[column];
+        if (id >= _columns.size()) _columns.resize(id + 1, npos);
+        if (_columns[id] != npos) {
+            throw runtime_error("Unit " + to_string(id) + " is recorded twice in the activations history.");
+        }
+        _columns[id] = column;
+    }
+
+    _times.reset(new atomic<int64_t>[size]);
+    _levels.reset(new atomic<Scalar>[size * _units.size()]);
+}
+
+template<typename Scalar>
+bool BasicActivationsHistory<Scalar>::has_unit(size_t id) const {
+    return id < _columns.size() && _columns[id] != npos;
+}
+
+template<typename Scalar>
+size_t BasicActivationsHistory<Scalar>::size() const {
+    auto count = _count.load(memory_order_acquire);
+    auto first = _first.load(memory_order_acquire);
+    return min(count - first, uint64_t(capacity()));
+}
+
+template<typename Scalar>
+void BasicActivationsHistory<Scalar>::clear() {
+    _first = _count.load();
+}
+
+template<typename Scalar>
+void BasicActivationsHistory<Scalar>::push(microseconds time, const VectorRef& activations) {
+
+    if (!_decimator.due(time)) return;
+
+    auto k = _count.load(memory_order_relaxed);
+
+    // the network time went back (the network was reset): the previous
+    // samples are not part of the history anymore
+    if (time < _last_time) _first.store(k, memory_order_release);
+    _last_time = time;
+
+    auto row = k & _mask;
+    auto size = _mask + 1;
+
+    // pairs with the acquire fence in `read`: a reader that sees any of the
+    // new values also sees that the slot is being reused
+    atomic_thread_fence(memory_order_release);
+
+    _times[row].store(time.count(), memory_order_relaxed);
+    for (size_t column = 0; column < _units.size(); column++) {
+        auto id = _units[column];
+        _levels[column * size + row].store(id < size_t(activations.size()) ? activations[id] : Scalar(NAN),
+                                           memory_order_relaxed);
+    }
+
+    _count.store(k + 1, memory_order_release);
+}
+
+template<typename Scalar>
+size_t BasicActivationsHistory<Scalar>::read(size_t id,
+                                             microseconds from,
+                                             microseconds to,
+                                             vector<microseconds>& times,
+                                             vector<Scalar>& levels) const {
+
+    if (!has_unit(id)) {
+        throw range_error("Unit " + to_string(id) + " is not recorded by this activations history.");
+    }
+
+    auto size = _mask + 1;
+    auto column = &_levels[_columns[id] * size];
+
+    for (;;) {
+
+        times.clear();
+        levels.clear();
+
+        auto end = _count.load(memory_order_acquire);
+        auto begin = max(_first.load(memory_order_acquire), end >= size ? end - size + 1 : 0);
+
+        auto time_of = [this](uint64_t k) {return _times[k & _mask].load(memory_order_relaxed);};
+
+        // the samples are in chronological order: binary search of the range
+        auto lo = begin, hi = end;
+        while (lo < hi) {
+            auto mid = lo + (hi - lo) / 2;
+            if (time_of(mid) < from.count()) lo = mid + 1;
+            else hi = mid;
+        }
+        auto first = lo;
+
+        hi = end;
+        while (lo < hi) {
+            auto mid = lo + (hi - lo) / 2;
+            if (time_of(mid) <= to.count()) lo = mid + 1;
+            else hi = mid;
+        }
+        auto last = lo;
+
+        for (auto k = first; k < last; k++) {
+            times.push_back(microseconds(time_of(k)));
+            levels.push_back(column[k & _mask].load(memory_order_relaxed));
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+
+        // retry if the producer started to overwrite (or the history was
+        // restarted over) any of the samples searched
+        auto count = _count.load(memory_order_relaxed);
+        auto safe = max(_first.load(memory_order_relaxed), count >= size ? count - size + 1 : 0);
+        if (safe <= begin) break;
+    }
+
+    return times.size();
+}
+
+template<typename Scalar>
+size_t BasicActivationsHistory<Scalar>::read(size_t id,
+                                             vector<microseconds>& times,
+                                             vector<Scalar>& levels) const {
+    return read(id, microseconds::min(), microseconds::max(), times, levels);
+}
+
+template class BasicActivationsHistory<double>;
+template class BasicActivationsHistory<float>;
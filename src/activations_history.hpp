@@ -0,0 +1,123 @@
+#ifndef ACTIVATIONS_HISTORY
+#define ACTIVATIONS_HISTORY
+
+#include <Eigen/Dense>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "decimator.hpp"
+
+/** The recent history of the activations of chosen units, sampled at a
+ * given rate (in network time).
+ *
+ * The history keeps the last `capacity` samples: one ring of samples per
+ * unit, all stored contiguously (column-major: the samples of a unit are
+ * contiguous), allocated once. Recording a sample (on the network thread)
+ * never allocates nor locks.
+ *
+ * Reads are lock-free, and can happen from any number of threads while the
+ * network records: a read that raced with the recording of the samples it
+ * copied is retried.
+ *
+ * Attached to a network with `BasicMemoryNetwork::log_history`.
+ */
+template<typename Scalar>
+class BasicActivationsHistory
+{
+
+public:
+
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+    typedef Eigen::Ref<const Vector> VectorRef;
+
+    /** Creates a history of the activations of `units` (network unit IDs),
+     * holding (at least) the last `capacity` samples taken at
+     * `sampling_rate` Hz (0 to keep every step).
+     *
+     * Units that do not exist yet are recorded as NaN until they are added
+     * to the network.
+     */
+    BasicActivationsHistory(const std::vector<size_t>& units,
+                            size_t capacity = 1024,
+                            double sampling_rate = 500);
+
+    BasicActivationsHistory(const BasicActivationsHistory&) = delete;
+    BasicActivationsHistory& operator=(const BasicActivationsHistory&) = delete;
+
+    const std::vector<size_t>& units() const {return _units;}
+    bool has_unit(size_t id) const;
+
+    /** Number of samples the history can hold.
+     */
+    size_t capacity() const {return _mask;}
+    double sampling_rate() const {return _sampling_rate;}
+
+    /** Number of samples currently held (at most `capacity`).
+     */
+    size_t size() const;
+
+    /** Copies the samples of unit `id` taken between `from` and `to`
+     * (inclusive) to `times` and `levels` (previous contents are replaced),
+     * oldest first. Returns the number of samples.
+     *
+     * Raises a `range_error` if the unit is not recorded by this history.
+     */
+    size_t read(size_t id,
+                std::chrono::microseconds from,
+                std::chrono::microseconds to,
+                std::vector<std::chrono::microseconds>& times,
+                std::vector<Scalar>& levels) const;
+
+    /** Copies all the samples of unit `id` (see `read`).
+     */
+    size_t read(size_t id,
+                std::vector<std::chrono::microseconds>& times,
+                std::vector<Scalar>& levels) const;
+
+    /** Forgets all the samples. *Must not be called while the network
+     * records.*
+     */
+    void clear();
+
+    /** Offers the activations of a network step to the history, which
+     * records them if a sample is due. Called by the network.
+     *
+     * *Must only be called from a single (producer) thread.*
+     */
+    void push(std::chrono::microseconds time, const VectorRef& activations);
+
+private:
+
+    std::vector<size_t> _units;
+
+    // column of each unit ID in `_levels`, or npos
+    std::vector<size_t> _columns;
+
+    size_t _mask;
+    double _sampling_rate;
+    Decimator _decimator; // producer only
+
+    // sample k is stored at row (k & _mask). Atomics, so that readers can
+    // copy slots the producer is overwriting (and then discard them).
+    std::unique_ptr<std::atomic<int64_t>[]> _times;
+    std::unique_ptr<std::atomic<Scalar>[]> _levels;
+
+    // samples ever recorded, and first sample since the last time the
+    // network time went back (older samples are not part of the history)
+    std::atomic<uint64_t> _count{0};
+    std::atomic<uint64_t> _first{0};
+    std::chrono::microseconds _last_time = std::chrono::microseconds::min();
+};
+
+// instantiated (and exported) by the library
+extern template class BasicActivationsHistory<double>;
+extern template class BasicActivationsHistory<float>;
+
+typedef BasicActivationsHistory<double> ActivationsHistory;
+typedef BasicActivationsHistory<float> ActivationsHistoryf;
+
+#endif
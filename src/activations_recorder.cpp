@@ -0,0 +1,640 @@
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "activations_recorder.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+// recordings start with this magic number, the version of the format, the
+// size of the scalars, and the offset of the last index block (0 if none
+// yet), the only value ever rewritten. Values are stored in the native byte
+// order.
+const char RECORDING_MAGIC[4] = {'A', 'M', 'R', 'C'};
+const uint32_t RECORDING_VERSION = 1;
+const size_t LAST_INDEX_POSITION = sizeof(RECORDING_MAGIC) + 2 * sizeof(uint32_t);
+const size_t RECORDING_HEADER_SIZE = LAST_INDEX_POSITION + sizeof(uint64_t);
+
+// then come blocks: a header (type, number of entries, size of the payload,
+// time range, checksum of the payload), then the payload
+enum BlockType : uint32_t {
+    UNITS_BLOCK = 1,       // (u64 id, u32 length, name)...
+    ACTIVATIONS_BLOCK = 2, // (u64 id, f64 level, i64 time, i64 duration)...
+    SAMPLES_BLOCK = 3,     // (i64 time, u64 nb units, scalars)...
+    INDEX_BLOCK = 4        // u64 previous index, (u64 offset, u32 type, u32 count, i64 first, i64 last)...
+};
+const size_t BLOCK_HEADER_SIZE = 2 * sizeof(uint32_t) + 4 * sizeof(uint64_t);
+const size_t ACTIVATION_SIZE = 4 * sizeof(uint64_t);
+const size_t INDEX_ENTRY_SIZE = 2 * sizeof(uint32_t) + 3 * sizeof(uint64_t);
+
+// an index is written every INDEX_INTERVAL blocks: a reader only has to
+// scan the blocks written since the last one
+const size_t INDEX_INTERVAL = 64;
+
+// number of samples the ring holds
+const size_t SAMPLES_CAPACITY = 64;
+
+// how often the writer thread drains the rings, between two flushes
+const microseconds DRAIN_PERIOD = milliseconds(1);
+
+template<typename T>
+void append(string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool extract(const char*& data, const char* end, T& value) {
+    if (size_t(end - data) < sizeof(T)) return false;
+    copy(data, data + sizeof(T), reinterpret_cast<char*>(&value));
+    data += sizeof(T);
+    return true;
+}
+
+// 64-bit FNV-1a
+uint64_t checksum(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+}
+
+template<typename Scalar>
+BasicActivationsRecorder<Scalar>::BasicActivationsRecorder(const string& filename,
+                                                           double sampling_rate,
+                                                           OverflowPolicy policy,
+                                                           microseconds flush_period,
+                                                           size_t capacity) :
+                _filename(filename),
+                _sampling_rate(sampling_rate),
+                _policy(policy),
+                _flush_period(flush_period),
+                _activations(capacity),
+                _samples(sampling_rate > 0 ? SAMPLES_CAPACITY : 1),
+                _decimator(sampling_rate)
+{
+    if (sampling_rate < 0) {
+        throw runtime_error("The sampling rate of an activations recorder can not be negative.");
+    }
+
+    _pending_activations.type = ACTIVATIONS_BLOCK;
+    _pending_samples.type = SAMPLES_BLOCK;
+
+    _file.open(filename, ios::binary | ios::trunc);
+    if (!_file) {
+        throw runtime_error("Can not open " + filename + " to write the recording.");
+    }
+
+    string header(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    append(header, RECORDING_VERSION);
+    append(header, uint32_t(sizeof(Scalar)));
+    append(header, uint64_t(0)); // no index yet
+
+    _file.write(header.data(), header.size());
+    _file.flush();
+    if (!_file) {
+        throw runtime_error("Error while writing the recording to " + filename);
+    }
+    _size = RECORDING_HEADER_SIZE;
+
+    _writing = true;
+    _writer = thread(&BasicActivationsRecorder::write, this);
+}
+
+template<typename Scalar>
+BasicActivationsRecorder<Scalar>::~BasicActivationsRecorder() {
+
+    if (!_writer.joinable()) return;
+
+    try {
+        stop();
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+    }
+}
+
+template<typename Scalar>
+void BasicActivationsRecorder<Scalar>::add_units(size_t first_id, const vector<string>& names) {
+
+    lock_guard<mutex> lock(_units_mutex);
+    for (size_t k = 0; k < names.size(); k++) {
+        _units.emplace_back(first_id + k, names[k]);
+    }
+}
+
+template<typename Scalar>
+microseconds BasicActivationsRecorder<Scalar>::monotonic(microseconds time) {
+
+    // the network was restarted: continue from the last time recorded
+    if (time + _time_offset < _last_time) _time_offset = _last_time - time;
+
+    _last_time = time + _time_offset;
+    return _last_time;
+}
+
+template<typename Scalar>
+void BasicActivationsRecorder<Scalar>::push(const RecordedActivation& activation) {
+
+    auto slot = _activations.claim();
+    if (!slot) {
+        if (_policy == OverflowPolicy::Drop) {
+            _dropped_activations++;
+            return;
+        }
+        while (!(slot = _activations.claim())) this_thread::yield();
+    }
+
+    *slot = activation;
+    slot->time = monotonic(activation.time);
+
+    _activations.publish();
+}
+
+template<typename Scalar>
+void BasicActivationsRecorder<Scalar>::push(microseconds time, const VectorRef& activations) {
+
+    if (_sampling_rate == 0 || !_decimator.due(time)) return;
+
+    auto sample = _samples.claim();
+    if (!sample) {
+        if (_policy == OverflowPolicy::Drop) {
+            _dropped_samples++;
+            return;
+        }
+        while (!(sample = _samples.claim())) this_thread::yield();
+    }
+
+    sample->time = monotonic(time);
+    sample->activations.assign(activations.data(), activations.data() + activations.size());
+
+    _samples.publish();
+}
+
+template<typename Scalar>
+void BasicActivationsRecorder<Scalar>::stop() {
+
+    if (!_writer.joinable()) return;
+
+    {
+        lock_guard<mutex> lock(_writer_mutex);
+        _writing = false;
+    }
+    _writer_condition.notify_one();
+    _writer.join();
+
+    if (_failed) {
+        throw runtime_error("The recording " + _filename + " could not be written: it is incomplete.");
+    }
+}
+
+template<typename Scalar>
+void BasicActivationsRecorder<Scalar>::write() {
+
+    auto last_flush = steady_clock::now();
+
+    for (;;) {
+
+        bool writing;
+        {
+            unique_lock<mutex> lock(_writer_mutex);
+            _writer_condition.wait_for(lock, DRAIN_PERIOD, [this]() {return !_writing;});
+            writing = _writing;
+        }
+
+        drain();
+
+        if (writing && steady_clock::now() - last_flush < _flush_period) continue;
+        last_flush = steady_clock::now();
+
+        // once the recording failed, only keep draining, so that the network
+        // is not blocked
+        if (_failed) {
+            _pending_activations.payload.clear();
+            _pending_activations.count = 0;
+            _pending_samples.payload.clear();
+            _pending_samples.count = 0;
+            lock_guard<mutex> lock(_units_mutex);
+            _units.clear();
+        }
+        else {
+            try {
+                flush(!writing);
+            }
+            catch (const exception& e) {
+                cerr << e.what() << endl;
+                _failed = true;
+            }
+        }
+
+        if (!writing) break;
+    }
+}
+
+template<typename Scalar>
+void BasicActivationsRecorder<Scalar>::drain() {
+
+    auto add = [](Block& block, microseconds time) {
+        if (block.count == 0) block.first = time.count();
+        block.last = time.count();
+        block.count++;
+    };
+
+    RecordedActivation* activation;
+    while ((activation = _activations.front())) {
+        auto& payload = _pending_activations.payload;
+        append(payload, uint64_t(activation->id));
+        append(payload, activation->level);
+        append(payload, int64_t(activation->time.count()));
+        append(payload, int64_t(activation->duration.count()));
+        add(_pending_activations, activation->time);
+        _activations.release();
+    }
+
+    Sample* sample;
+    while ((sample = _samples.front())) {
+        auto& payload = _pending_samples.payload;
+        append(payload, int64_t(sample->time.count()));
+        append(payload, uint64_t(sample->activations.size()));
+        payload.append(reinterpret_cast<const char*>(sample->activations.data()),
+                       sample->activations.size() * sizeof(Scalar));
+        add(_pending_samples, sample->time);
+        _samples.release();
+    }
+}
+
+template<typename Scalar>
+void BasicActivationsRecorder<Scalar>::flush(bool index) {
+
+    // after draining the rings: the units of the activations drained are
+    // either already written, or in this block (units are registered here
+    // before the network steps them, see `BasicMemoryNetwork::add_unit`)
+    vector<pair<size_t, string>> units;
+    {
+        lock_guard<mutex> lock(_units_mutex);
+        units.swap(_units);
+    }
+
+    if (!units.empty()) {
+        Block block;
+        block.type = UNITS_BLOCK;
+        for (const auto& unit : units) {
+            append(block.payload, uint64_t(unit.first));
+            append(block.payload, uint32_t(unit.second.size()));
+            block.payload.append(unit.second);
+            block.count++;
+        }
+        write_block(block);
+    }
+
+    if (_pending_activations.count) write_block(_pending_activations);
+    if (_pending_samples.count) write_block(_pending_samples);
+
+    _file.flush();
+    if (!_file) {
+        throw runtime_error("Error while writing the recording to " + _filename);
+    }
+
+    if (_unindexed.size() >= INDEX_INTERVAL || (index && !_unindexed.empty())) {
+        write_index();
+    }
+}
+
+template<typename Scalar>
+void BasicActivationsRecorder<Scalar>::write_block(Block& block) {
+
+    string header;
+    append(header, block.type);
+    append(header, block.count);
+    append(header, uint64_t(block.payload.size()));
+    append(header, block.first);
+    append(header, block.last);
+    append(header, checksum(block.payload.data(), block.payload.size()));
+
+    _file.write(header.data(), header.size());
+    _file.write(block.payload.data(), block.payload.size());
+
+    if (block.type != INDEX_BLOCK) {
+        _unindexed.push_back({_size, block.type, block.count, block.first, block.last});
+    }
+    _size += header.size() + block.payload.size();
+
+    block.payload.clear();
+    block.count = 0;
+}
+
+template<typename Scalar>
+void BasicActivationsRecorder<Scalar>::write_index() {
+
+    Block index;
+    index.type = INDEX_BLOCK;
+    append(index.payload, _last_index);
+    for (const auto& entry : _unindexed) {
+        append(index.payload, entry.offset);
+        append(index.payload, entry.type);
+        append(index.payload, entry.count);
+        append(index.payload, entry.first);
+        append(index.payload, entry.last);
+        index.count++;
+    }
+
+    uint64_t offset = _size;
+    write_block(index);
+    _file.flush();
+
+    // only point to the index once it is written
+    _file.seekp(LAST_INDEX_POSITION);
+    _file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    _file.seekp(0, ios::end);
+    _file.flush();
+    if (!_file) {
+        throw runtime_error("Error while writing the index of the recording " + _filename);
+    }
+
+    _last_index = offset;
+    _unindexed.clear();
+}
+
+template<typename Scalar>
+BasicActivationsRecording<Scalar>::BasicActivationsRecording(const string& filename) :
+                _filename(filename),
+                _file(filename, ios::binary),
+                _scanned(RECORDING_HEADER_SIZE)
+{
+    if (!_file) {
+        throw runtime_error("Can not open the recording " + filename);
+    }
+
+    char magic[sizeof(RECORDING_MAGIC)];
+    uint32_t version;
+    _file.read(magic, sizeof(magic));
+    _file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    _file.read(reinterpret_cast<char*>(&_scalar_size), sizeof(_scalar_size));
+    if (!_file || !equal(magic, magic + sizeof(magic), RECORDING_MAGIC)) {
+        throw runtime_error(filename + " is not an activations recording.");
+    }
+    if (version != RECORDING_VERSION) {
+        throw runtime_error("Unsupported recording version " + to_string(version)
+                            + " (expected " + to_string(RECORDING_VERSION) + ").");
+    }
+    if (_scalar_size != sizeof(float) && _scalar_size != sizeof(double)) {
+        throw runtime_error("Corrupted recording: invalid scalar size.");
+    }
+
+    refresh();
+}
+
+template<typename Scalar>
+bool BasicActivationsRecording<Scalar>::read_block(uint64_t offset,
+                                                   uint32_t& type,
+                                                   BlockInfo& info,
+                                                   string& payload) {
+    _file.clear();
+    _file.seekg(0, ios::end);
+    uint64_t file_size = _file.tellg();
+    if (offset + BLOCK_HEADER_SIZE > file_size) return false;
+
+    uint64_t size, stored_checksum;
+    _file.seekg(offset);
+    _file.read(reinterpret_cast<char*>(&type), sizeof(type));
+    _file.read(reinterpret_cast<char*>(&info.count), sizeof(info.count));
+    _file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    _file.read(reinterpret_cast<char*>(&info.first), sizeof(info.first));
+    _file.read(reinterpret_cast<char*>(&info.last), sizeof(info.last));
+    _file.read(reinterpret_cast<char*>(&stored_checksum), sizeof(stored_checksum));
+    if (!_file || size > file_size - offset - BLOCK_HEADER_SIZE) return false;
+
+    payload.resize(size);
+    _file.read(&payload[0], size);
+
+    info.offset = offset;
+    return _file && checksum(payload.data(), payload.size()) == stored_checksum;
+}
+
+template<typename Scalar>
+void BasicActivationsRecording<Scalar>::refresh() {
+
+    uint64_t last_index;
+    _file.clear();
+    _file.seekg(LAST_INDEX_POSITION);
+    _file.read(reinterpret_cast<char*>(&last_index), sizeof(last_index));
+    if (!_file) last_index = 0;
+
+    uint32_t type;
+    BlockInfo info;
+    string payload;
+
+    // walk back the indexes written since the last refresh. If one can not
+    // be read, the blocks are found by scanning the file instead.
+    struct Index {
+        BlockInfo info;
+        size_t size;
+        vector<pair<uint32_t, BlockInfo>> entries;
+    };
+    vector<Index> indexes;
+    for (auto offset = last_index; offset >= _scanned; ) {
+
+        if (!read_block(offset, type, info, payload) || type != INDEX_BLOCK
+                || payload.size() != sizeof(uint64_t) + info.count * INDEX_ENTRY_SIZE) {
+            indexes.clear();
+            break;
+        }
+
+        auto data = payload.data();
+        auto end = data + payload.size();
+
+        uint64_t previous;
+        Index index{info, payload.size(), {}};
+        bool valid = extract(data, end, previous);
+        while (valid && data < end) {
+            uint32_t entry_type;
+            BlockInfo entry;
+            valid = extract(data, end, entry.offset) && extract(data, end, entry_type)
+                    && extract(data, end, entry.count) && extract(data, end, entry.first)
+                    && extract(data, end, entry.last);
+            if (valid) index.entries.emplace_back(entry_type, entry);
+        }
+        if (!valid) {
+            indexes.clear();
+            break;
+        }
+        indexes.push_back(move(index));
+
+        if (previous >= offset) break;
+        offset = previous;
+    }
+
+    for (auto index = indexes.rbegin(); index != indexes.rend(); ++index) {
+
+        for (const auto& entry : index->entries) {
+
+            if (entry.second.offset < _scanned) continue;
+
+            if (entry.first == UNITS_BLOCK) {
+                if (!read_block(entry.second.offset, type, info, payload)) {
+                    throw runtime_error("Corrupted recording " + _filename + ": can not read the units.");
+                }
+                read_units(payload);
+            }
+            add_block(entry.first, entry.second);
+        }
+
+        _last_index = index->info.offset;
+        _scanned = _last_index + BLOCK_HEADER_SIZE + index->size;
+    }
+
+    // then scan the blocks written since the last index
+    while (read_block(_scanned, type, info, payload)) {
+
+        if (type == INDEX_BLOCK) _last_index = info.offset;
+        else {
+            if (type == UNITS_BLOCK) read_units(payload);
+            add_block(type, info);
+        }
+
+        _scanned += BLOCK_HEADER_SIZE + payload.size();
+    }
+}
+
+template<typename Scalar>
+void BasicActivationsRecording<Scalar>::add_block(uint32_t type, const BlockInfo& info) {
+
+    if (type == ACTIVATIONS_BLOCK) {
+        _activations_blocks.push_back(info);
+        _nb_activations += info.count;
+    }
+    else if (type == SAMPLES_BLOCK) {
+        _samples_blocks.push_back(info);
+        _nb_samples += info.count;
+    }
+    else return;
+
+    _duration = max(_duration, microseconds(info.last));
+}
+
+template<typename Scalar>
+void BasicActivationsRecording<Scalar>::read_units(const string& payload) {
+
+    auto data = payload.data();
+    auto end = data + payload.size();
+
+    uint64_t id;
+    uint32_t length;
+    while (extract(data, end, id) && extract(data, end, length)) {
+        if (size_t(end - data) < length) break;
+        if (id >= _names.size()) _names.resize(id + 1);
+        _names[id].assign(data, length);
+        data += length;
+    }
+}
+
+template<typename Scalar>
+pair<size_t, size_t> BasicActivationsRecording<Scalar>::range(const vector<BlockInfo>& blocks,
+                                                             microseconds begin,
+                                                             microseconds end) const {
+    // blocks are written in chronological order
+    auto first = partition_point(blocks.begin(), blocks.end(),
+                                 [begin](const BlockInfo& block) {return block.last < begin.count();});
+    auto last = partition_point(first, blocks.end(),
+                                [end](const BlockInfo& block) {return block.first < end.count();});
+
+    return {first - blocks.begin(), last - blocks.begin()};
+}
+
+template<typename Scalar>
+vector<RecordedActivation> BasicActivationsRecording<Scalar>::activations(microseconds begin,
+                                                                          microseconds end) {
+    vector<RecordedActivation> activations;
+
+    uint32_t type;
+    BlockInfo info;
+    string payload;
+
+    auto blocks = range(_activations_blocks, begin, end);
+    for (auto k = blocks.first; k < blocks.second; k++) {
+
+        if (!read_block(_activations_blocks[k].offset, type, info, payload)
+                || payload.size() != info.count * ACTIVATION_SIZE) {
+            throw runtime_error("Corrupted recording " + _filename);
+        }
+
+        auto data = payload.data();
+        auto data_end = data + payload.size();
+        while (data < data_end) {
+            uint64_t id;
+            double level;
+            int64_t time, duration;
+            if (!extract(data, data_end, id) || !extract(data, data_end, level)
+                    || !extract(data, data_end, time) || !extract(data, data_end, duration)) {
+                throw runtime_error("Corrupted recording " + _filename);
+            }
+
+            if (time < begin.count() || time >= end.count()) continue;
+            activations.push_back({id, level, microseconds(time), microseconds(duration)});
+        }
+    }
+
+    return activations;
+}
+
+template<typename Scalar>
+size_t BasicActivationsRecording<Scalar>::samples(microseconds begin,
+                                                  microseconds end,
+                                                  const SampleFunction& consume) {
+    size_t nb_samples = 0;
+
+    uint32_t type;
+    BlockInfo info;
+    string payload;
+    Vector activations;
+
+    auto blocks = range(_samples_blocks, begin, end);
+    for (auto k = blocks.first; k < blocks.second; k++) {
+
+        if (!read_block(_samples_blocks[k].offset, type, info, payload)) {
+            throw runtime_error("Corrupted recording " + _filename);
+        }
+
+        auto data = payload.data();
+        auto data_end = data + payload.size();
+        for (uint32_t s = 0; s < info.count; s++) {
+            int64_t time;
+            uint64_t nb_units;
+            if (!extract(data, data_end, time) || !extract(data, data_end, nb_units)
+                    || nb_units > size_t(data_end - data) / _scalar_size) {
+                throw runtime_error("Corrupted recording " + _filename);
+            }
+
+            if (time < begin.count() || time >= end.count()) {
+                data += nb_units * _scalar_size;
+                continue;
+            }
+
+            // recordings of the other precision are converted
+            activations.resize(nb_units);
+            if (_scalar_size == sizeof(float)) {
+                activations = Eigen::Map<const Eigen::VectorXf>(reinterpret_cast<const float*>(data), nb_units).template cast<Scalar>();
+            }
+            else {
+                activations = Eigen::Map<const Eigen::VectorXd>(reinterpret_cast<const double*>(data), nb_units).template cast<Scalar>();
+            }
+            data += nb_units * _scalar_size;
+
+            consume(microseconds(time), activations);
+            nb_samples++;
+        }
+    }
+
+    return nb_samples;
+}
+
+template class BasicActivationsRecorder<double>;
+template class BasicActivationsRecorder<float>;
+template class BasicActivationsRecording<double>;
+template class BasicActivationsRecording<float>;
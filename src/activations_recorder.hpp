@@ -0,0 +1,289 @@
+#ifndef ACTIVATIONS_RECORDER
+#define ACTIVATIONS_RECORDER
+
+#include <Eigen/Dense>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "activations_sink.hpp" // OverflowPolicy
+#include "decimator.hpp"
+#include "spsc_ring.hpp"
+
+/** An external activation, as recorded in an activations recording.
+ */
+struct RecordedActivation {
+    size_t id;
+    double level;
+    std::chrono::microseconds time; // when the network applied it
+    std::chrono::microseconds duration;
+};
+
+/** Records the external activations applied to a network (and, optionally,
+ * the activations of all its units, sampled at `sampling_rate`) to an
+ * append-only binary file, that can be read (with
+ * `BasicActivationsRecording`) while it is being written.
+ *
+ * The network thread only copies the events and samples into bounded rings;
+ * a background thread writes them to the file every `flush_period`, as
+ * checksummed blocks. Every few blocks, an index of the blocks (offsets and
+ * time ranges) is appended, and the header of the file is updated to point
+ * to it: the memory used does not grow with the length of the recording.
+ *
+ * Times are in network time. As the network time restarts at 0 when the
+ * network is restarted, the times of a run are shifted to follow the end of
+ * the previous one.
+ *
+ * Attached to a network with `BasicMemoryNetwork::record_activations`.
+ */
+template<typename Scalar>
+class BasicActivationsRecorder
+{
+
+public:
+
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+    typedef Eigen::Ref<const Vector> VectorRef;
+
+    /** Creates (or truncates) the recording file, and starts the writer
+     * thread. A `sampling_rate` (in Hz) of 0 only records the external
+     * activations. `capacity` is the number of external activations the
+     * ring can hold; `policy` tells what to do when a ring is full.
+     *
+     * Raises a `runtime_error` if the file can not be created.
+     */
+    BasicActivationsRecorder(const std::string& filename,
+                             double sampling_rate = 0,
+                             OverflowPolicy policy = OverflowPolicy::Drop,
+                             std::chrono::microseconds flush_period = std::chrono::milliseconds(100),
+                             size_t capacity = 4096);
+
+    ~BasicActivationsRecorder();
+
+    BasicActivationsRecorder(const BasicActivationsRecorder&) = delete;
+    BasicActivationsRecorder& operator=(const BasicActivationsRecorder&) = delete;
+
+    const std::string& filename() const {return _filename;}
+    double sampling_rate() const {return _sampling_rate;}
+    OverflowPolicy policy() const {return _policy;}
+
+    /** Records units, `first_id` being the ID of the first one. Can be
+     * called from any thread.
+     */
+    void add_units(size_t first_id, const std::vector<std::string>& names);
+
+    /** Records an external activation (`push(activation)`), or offers the
+     * activations of a network step, kept if a sample is due
+     * (`push(time, activations)`). Called by the network.
+     *
+     * *Must only be called from a single (producer) thread.*
+     */
+    void push(const RecordedActivation& activation);
+    void push(std::chrono::microseconds time, const VectorRef& activations);
+
+    /** Writes the pending events and a last index, and stops the writer
+     * thread.
+     *
+     * Raises a `runtime_error` if the recording could not be written.
+     */
+    void stop();
+
+    /** Number of external activations (resp. samples) dropped because the
+     * ring was full (`Drop` policy).
+     */
+    size_t dropped_activations() const {return _dropped_activations;}
+    size_t dropped_samples() const {return _dropped_samples;}
+
+    /** Number of bytes written to the file.
+     */
+    size_t size() const {return _size;}
+
+private:
+
+    struct Sample {
+        std::chrono::microseconds time;
+        std::vector<Scalar> activations;
+    };
+
+    std::string _filename;
+    double _sampling_rate;
+    OverflowPolicy _policy;
+    std::chrono::microseconds _flush_period;
+
+    SPSCRing<RecordedActivation> _activations;
+    SPSCRing<Sample> _samples;
+
+    // producer only
+    Decimator _decimator;
+    std::chrono::microseconds _time_offset = std::chrono::microseconds::zero();
+    std::chrono::microseconds _last_time = std::chrono::microseconds::zero();
+
+    std::chrono::microseconds monotonic(std::chrono::microseconds time);
+
+    std::atomic<size_t> _dropped_activations{0};
+    std::atomic<size_t> _dropped_samples{0};
+
+    // units not written yet
+    std::mutex _units_mutex;
+    std::vector<std::pair<size_t, std::string>> _units;
+
+    // writer thread only: the payloads of the next blocks, and the blocks
+    // written since the last index
+    struct Block {
+        uint32_t type;
+        uint32_t count = 0;
+        int64_t first = 0;
+        int64_t last = 0;
+        std::string payload;
+    };
+    Block _pending_activations;
+    Block _pending_samples;
+
+    struct IndexEntry {
+        uint64_t offset;
+        uint32_t type;
+        uint32_t count;
+        int64_t first;
+        int64_t last;
+    };
+    std::vector<IndexEntry> _unindexed;
+    uint64_t _last_index = 0;
+
+    std::ofstream _file;
+    std::atomic<size_t> _size{0};
+    std::atomic<bool> _failed{false};
+
+    std::thread _writer;
+    std::atomic<bool> _writing{false};
+    std::mutex _writer_mutex;
+    std::condition_variable _writer_condition;
+
+    void write();
+
+    /** Drains the rings into the pending blocks.
+     */
+    void drain();
+
+    /** Writes the pending blocks, and an index if enough blocks were
+     * written since the last one (or if `index` is true).
+     */
+    void flush(bool index);
+
+    void write_block(Block& block);
+    void write_index();
+};
+
+/** Reads a file written by a `BasicActivationsRecorder`, possibly while it
+ * is still being written (see `refresh`).
+ *
+ * Only the index of the blocks (and the unit names) are kept in memory:
+ * queries read the blocks overlapping the requested time range from the
+ * file. Not thread-safe.
+ */
+template<typename Scalar>
+class BasicActivationsRecording
+{
+
+public:
+
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+    typedef Eigen::Ref<const Vector> VectorRef;
+
+    typedef std::function<void(std::chrono::microseconds,
+                               const VectorRef&)> SampleFunction;
+
+    /** Opens a recording, and reads its index. Raises a `runtime_error` if
+     * the file is not a recording.
+     */
+    explicit BasicActivationsRecording(const std::string& filename);
+
+    /** Reads the blocks written since the recording was opened (or last
+     * refreshed). The end of a recording being written, or of one whose
+     * writer crashed, is ignored up to the first incomplete block.
+     */
+    void refresh();
+
+    /** Names of the units, by ID.
+     */
+    const std::vector<std::string>& names() const {return _names;}
+
+    /** Time of the last event or sample recorded.
+     */
+    std::chrono::microseconds duration() const {return _duration;}
+
+    size_t nb_activations() const {return _nb_activations;}
+    size_t nb_samples() const {return _nb_samples;}
+
+    /** Returns the external activations applied in [begin, end), in
+     * chronological order.
+     */
+    std::vector<RecordedActivation> activations(std::chrono::microseconds begin,
+                                                std::chrono::microseconds end);
+
+    /** Calls `consume(time, activations)` for each sample taken in
+     * [begin, end), in chronological order, and returns the number of
+     * samples.
+     */
+    size_t samples(std::chrono::microseconds begin,
+                   std::chrono::microseconds end,
+                   const SampleFunction& consume);
+
+private:
+
+    struct BlockInfo {
+        uint64_t offset;
+        uint32_t count;
+        int64_t first;
+        int64_t last;
+    };
+
+    std::string _filename;
+    std::ifstream _file;
+    uint32_t _scalar_size;
+
+    std::vector<std::string> _names;
+    std::vector<BlockInfo> _activations_blocks;
+    std::vector<BlockInfo> _samples_blocks;
+    std::chrono::microseconds _duration = std::chrono::microseconds::zero();
+    size_t _nb_activations = 0;
+    size_t _nb_samples = 0;
+
+    uint64_t _scanned; // offset of the first block not read yet
+    uint64_t _last_index = 0;
+
+    /** Reads the block at `offset` (header and checksummed payload).
+     * Returns false if it is incomplete or corrupted.
+     */
+    bool read_block(uint64_t offset, uint32_t& type, BlockInfo& info, std::string& payload);
+
+    void add_block(uint32_t type, const BlockInfo& info);
+    void read_units(const std::string& payload);
+
+    /** The blocks of `blocks` that may hold times in [begin, end).
+     */
+    std::pair<size_t, size_t> range(const std::vector<BlockInfo>& blocks,
+                                    std::chrono::microseconds begin,
+                                    std::chrono::microseconds end) const;
+};
+
+// instantiated (and exported) by the library
+extern template class BasicActivationsRecorder<double>;
+extern template class BasicActivationsRecorder<float>;
+extern template class BasicActivationsRecording<double>;
+extern template class BasicActivationsRecording<float>;
+
+typedef BasicActivationsRecorder<double> ActivationsRecorder;
+typedef BasicActivationsRecorder<float> ActivationsRecorderf;
+typedef BasicActivationsRecording<double> ActivationsRecording;
+typedef BasicActivationsRecording<float> ActivationsRecordingf;
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdexcept>
+
+#include "activations_sink.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+template<typename Scalar>
+BasicActivationsSink<Scalar>::BasicActivationsSink(size_t capacity,
+                                                   double sampling_rate,
+                                                   OverflowPolicy policy,
+                                                   size_t nb_units) :
+                _ring(capacity),
+                _sampling_rate(sampling_rate),
+                _decimator(sampling_rate),
+                _policy(policy),
+                _nb_units(nb_units)
+{
+    if (sampling_rate < 0) {
+        throw runtime_error("The sampling rate of an activations sink can not be negative.");
+    }
+
+    for (size_t i = 0; i < _ring.capacity(); i++) {
+        _ring.slot(i).activations.reserve(nb_units);
+    }
+}
+
+template<typename Scalar>
+BasicActivationsSink<Scalar>::~BasicActivationsSink() {
+    stop();
+}
+
+template<typename Scalar>
+void BasicActivationsSink<Scalar>::push(microseconds time, const VectorRef& activations) {
+
+    if (!_decimator.due(time)) return;
+
+    auto sample = _ring.claim();
+    if (!sample) {
+        if (_policy == OverflowPolicy::Drop) {
+            _dropped++;
+            return;
+        }
+        while (!(sample = _ring.claim())) this_thread::yield();
+    }
+
+    sample->time = time;
+    sample->activations.assign(activations.data(), activations.data() + activations.size());
+
+    _ring.publish();
+}
+
+template<typename Scalar>
+void BasicActivationsSink<Scalar>::reserve(size_t nb_units) {
+
+    if (nb_units <= _nb_units) return;
+    _nb_units = nb_units;
+
+    _ring.for_each_free([nb_units](Sample& sample) {sample.activations.reserve(nb_units);});
+}
+
+template<typename Scalar>
+size_t BasicActivationsSink<Scalar>::poll(const LoggingFunction& consume, size_t max_samples) {
+
+    size_t nb_samples = 0;
+
+    Sample* sample;
+    while (nb_samples < max_samples && (sample = _ring.front())) {
+
+        Eigen::Map<const Vector> activations(sample->activations.data(), sample->activations.size());
+        consume(sample->time, activations);
+
+        // the network grew while the sample was being consumed
+        if (sample->activations.capacity() < _nb_units) sample->activations.reserve(_nb_units);
+
+        _ring.release();
+        nb_samples++;
+    }
+
+    return nb_samples;
+}
+
+template<typename Scalar>
+void BasicActivationsSink<Scalar>::start(LoggingFunction consume, microseconds poll_period) {
+
+    if (_consumer.joinable()) {
+        throw runtime_error("The activations sink already has a consumer thread.");
+    }
+
+    _consuming = true;
+    _consumer = thread([this, consume, poll_period]() {
+        while (_consuming) {
+            if (poll(consume) == 0) this_thread::sleep_for(poll_period);
+        }
+        poll(consume);
+    });
+}
+
+template<typename Scalar>
+void BasicActivationsSink<Scalar>::stop() {
+
+    if (!_consumer.joinable()) return;
+
+    _consuming = false;
+    _consumer.join();
+}
+
+template class BasicActivationsSink<double>;
+template class BasicActivationsSink<float>;
@@ -0,0 +1,144 @@
+#ifndef ACTIVATIONS_SINK
+#define ACTIVATIONS_SINK
+
+#include <Eigen/Dense>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "decimator.hpp"
+#include "spsc_ring.hpp"
+
+/** What an `ActivationsSink` does with a sample when its ring is full.
+ *
+ * - `Drop`: the sample is dropped (and counted, see `dropped`). The network
+ *   is never slowed down by the consumer.
+ * - `Block`: the network thread waits for the consumer to make room. No
+ *   sample is lost, but a slow consumer throttles the network, and *a sink
+ *   that is never drained blocks the network forever*.
+ */
+enum class OverflowPolicy {Drop, Block};
+
+/** Asynchronous logging of the activations of a network.
+ *
+ * The network thread copies the activations (decimated to `sampling_rate`,
+ * in network time) into a ring of pre-allocated samples. They are consumed
+ * on another thread, either by calling `poll`, or by a consumer thread
+ * started with `start`. Unlike the logging callbacks of
+ * `BasicMemoryNetwork`, a slow consumer does not slow down the network
+ * (unless the `Block` policy is used).
+ *
+ * Attached to a network with `BasicMemoryNetwork::log_activations` (or
+ * `log_external_activations`).
+ */
+template<typename Scalar>
+class BasicActivationsSink
+{
+
+public:
+
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+    typedef Eigen::Ref<const Vector> VectorRef;
+
+    typedef std::function<void(std::chrono::duration<long int, std::micro>,
+                               const VectorRef&)> LoggingFunction;
+
+    /** Creates a sink holding up to `capacity` samples (rounded up to the
+     * next power of two). Samples are pre-allocated for `nb_units` units,
+     * then for the capacity of the network the sink is attached to (see
+     * `reserve`).
+     *
+     * A `sampling_rate` (in Hz) of 0 keeps the activations of every step.
+     */
+    BasicActivationsSink(size_t capacity = 1024,
+                         double sampling_rate = 0,
+                         OverflowPolicy policy = OverflowPolicy::Drop,
+                         size_t nb_units = 256);
+
+    ~BasicActivationsSink();
+
+    BasicActivationsSink(const BasicActivationsSink&) = delete;
+    BasicActivationsSink& operator=(const BasicActivationsSink&) = delete;
+
+    /** Calls `consume(time, activations)` for (at most `max_samples` of)
+     * the pending samples, oldest first, and returns the number of samples
+     * consumed.
+     *
+     * Must not be called concurrently with itself, nor while a consumer
+     * thread runs (see `start`).
+     */
+    size_t poll(const LoggingFunction& consume,
+                size_t max_samples = std::numeric_limits<size_t>::max());
+
+    /** Starts a consumer thread, that polls the sink every `poll_period`.
+     * Raises a `runtime_error` if a consumer thread is already running.
+     */
+    void start(LoggingFunction consume,
+               std::chrono::microseconds poll_period = std::chrono::milliseconds(1));
+
+    /** Stops the consumer thread, once it has consumed the pending samples.
+     */
+    void stop();
+
+    /** Number of samples waiting to be consumed.
+     */
+    size_t pending() const {return _ring.size();}
+
+    /** Number of samples dropped because the ring was full (`Drop` policy).
+     */
+    size_t dropped() const {return _dropped;}
+
+    double sampling_rate() const {return _sampling_rate;}
+    OverflowPolicy policy() const {return _policy;}
+
+    /** Offers the activations of a network step to the sink, which keeps
+     * them if a sample is due. Called by the network.
+     *
+     * *Must only be called from a single (producer) thread.*
+     */
+    void push(std::chrono::microseconds time, const VectorRef& activations);
+
+    /** Pre-allocates the samples for `nb_units` units, so that `push` does
+     * not allocate. Called by the network when its capacity grows. The
+     * samples being consumed are grown by the consumer, before being
+     * released (a sample released while `reserve` runs is only grown by the
+     * next `push` that uses it).
+     *
+     * *Must only be called from the producer thread.*
+     */
+    void reserve(size_t nb_units);
+
+private:
+
+    struct Sample {
+        std::chrono::microseconds time;
+        std::vector<Scalar> activations;
+    };
+
+    SPSCRing<Sample> _ring;
+
+    double _sampling_rate;
+    Decimator _decimator; // producer only
+    OverflowPolicy _policy;
+
+    std::atomic<size_t> _dropped{0};
+
+    // number of units the samples are allocated for
+    std::atomic<size_t> _nb_units;
+
+    std::thread _consumer;
+    std::atomic<bool> _consuming{false};
+};
+
+// instantiated (and exported) by the library
+extern template class BasicActivationsSink<double>;
+extern template class BasicActivationsSink<float>;
+
+typedef BasicActivationsSink<double> ActivationsSink;
+typedef BasicActivationsSink<float> ActivationsSinkf;
+
+#endif
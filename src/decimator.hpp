@@ -0,0 +1,58 @@
+#ifndef DECIMATOR
+#define DECIMATOR
+
+#include <chrono>
+
+/** Decides which network steps to keep when sampling the activations at a
+ * given rate, in network time.
+ *
+ * Samples stay on a fixed grid (one every `1 / sampling_rate`, from the
+ * first step), whatever the period of the network: steps slower than the
+ * sampling period do not make the grid drift, and the samples they skip are
+ * not made up for. If the time goes back (the network was reset), the grid
+ * restarts at the next step.
+ */
+class Decimator
+{
+
+public:
+
+    /** A `sampling_rate` (in Hz) of 0 keeps every step.
+     */
+    explicit Decimator(double sampling_rate) :
+        _period(sampling_rate > 0 ? std::chrono::microseconds(long(std::micro::den / sampling_rate))
+                                  : std::chrono::microseconds::zero()) {}
+
+    /** Returns true if the step at `time` must be sampled. Returns true for
+     * the first step, and for the first step after the time went back.
+     */
+    bool due(std::chrono::microseconds time) {
+
+        bool restarted = time < _last_time;
+        _last_time = time;
+
+        if (_period == std::chrono::microseconds::zero()) return true;
+
+        if (restarted || !_started) {
+            _started = true;
+            _next = time + _period;
+            return true;
+        }
+
+        if (time < _next) return false;
+
+        while (_next <= time) _next += _period;
+        return true;
+    }
+
+    std::chrono::microseconds period() const {return _period;}
+
+private:
+
+    std::chrono::microseconds _period;
+    std::chrono::microseconds _next = std::chrono::microseconds::zero();
+    std::chrono::microseconds _last_time = std::chrono::microseconds::min();
+    bool _started = false;
+};
+
+#endif
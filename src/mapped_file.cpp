@@ -0,0 +1,51 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+
+using namespace std;
+
+MappedFile::MappedFile(const string& filename) {
+
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Can not open " + filename + ": " + strerror(errno));
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) < 0) {
+        auto error = errno;
+        close(fd);
+        throw runtime_error("Can not read the size of " + filename + ": " + strerror(error));
+    }
+
+    if (status.st_size == 0) {
+        close(fd);
+        throw runtime_error("Can not map " + filename + ": the file is empty.");
+    }
+
+    // private, writable mapping of a read-only file: written pages are
+    // copied, the file itself can not be modified
+    auto data = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    auto error = errno;
+
+    // the mapping keeps its own reference to the file
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        throw runtime_error("Can not map " + filename + ": " + strerror(error));
+    }
+
+    _data = static_cast<char*>(data);
+    _size = status.st_size;
+}
+
+MappedFile::~MappedFile() {
+    munmap(_data, _size);
+}
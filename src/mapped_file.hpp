@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE
+#define MAPPED_FILE
+
+#include <cstddef>
+#include <string>
+
+/** A whole file, mapped in memory (with POSIX `mmap`), copy-on-write.
+ *
+ * The pages of the file are loaded lazily, and shared (through the page
+ * cache) with every other process mapping the same file. Writing to a page
+ * gives this mapping a private copy of that page only: the file, and the
+ * other processes, never see the change.
+ */
+class MappedFile
+{
+
+public:
+
+    /** Maps `filename`. Raises a `runtime_error` if the file can not be
+     * opened, or is empty.
+     */
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    char* data() {return _data;}
+    const char* data() const {return _data;}
+    size_t size() const {return _size;}
+
+private:
+
+    char* _data = nullptr;
+    size_t _size = 0;
+};
+
+#endif
@@ -0,0 +1,382 @@
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "memory_ensemble.hpp"
+
+using namespace Eigen;
+using namespace std;
+using namespace std::chrono;
+
+// maximum number of external activations that can be queued between two
+// steps, for the whole ensemble
+const size_t ENSEMBLE_ACTIVATIONS_QUEUE_CAPACITY = 16384;
+
+// minimum number of units the ensemble is allocated for
+const size_t ENSEMBLE_MIN_CAPACITY = 16;
+
+// the members are stepped by tiles whose weights fit in this many bytes (ie,
+// in a typical L2 cache)
+const size_t ENSEMBLE_TILE_BYTES = 1 << 20;
+
+template<typename Scalar>
+BasicMemoryEnsemble<Scalar>::BasicMemoryEnsemble(size_t nb_members,
+                                                 microseconds period,
+                                                 double Dg,
+                                                 double Lg,
+                                                 double Eg,
+                                                 double Ig,
+                                                 double Amax,
+                                                 double Amin,
+                                                 double Arest,
+                                                 double Winit) :
+                Dg(Dg),
+                Lg(Lg),
+                Eg(Eg),
+                Ig(Ig),
+                Amax(Amax),
+                Amin(Amin),
+                Arest(Arest),
+                Winit(Winit),
+                _nb_members(nb_members),
+                _period(period),
+                external_activations(0, nb_members),
+                external_activations_decay(0, nb_members),
+                internal_activations(0, nb_members),
+                _activations(0, nb_members),
+                _stimulated_units(nb_members),
+                _connected_units(nb_members),
+                _activations_queue(ENSEMBLE_ACTIVATIONS_QUEUE_CAPACITY)
+{
+    if (period <= microseconds::zero()) {
+        throw runtime_error("The period of a memory ensemble must be strictly positive.");
+    }
+
+    reset();
+}
+
+template<typename Scalar>
+void BasicMemoryEnsemble<Scalar>::reset() {
+
+    external_activations.fill(0);
+    external_activations_decay.fill(0);
+    internal_activations.fill(0);
+    _activations.fill(Arest);
+
+    _weights.fill(0);
+    _connectivity.fill(false);
+    for (auto& connected : _connected_units) connected.clear();
+
+    _elapsed_time = microseconds::zero();
+}
+
+template<typename Scalar>
+size_t BasicMemoryEnsemble<Scalar>::add_unit(const string& name) {
+    return _units.add(name);
+}
+
+template<typename Scalar>
+size_t BasicMemoryEnsemble<Scalar>::add_units(const vector<string>& names) {
+
+    auto first_id = _units.size();
+    _units.reserve(first_id + names.size());
+
+    for (const auto& name : names) _units.add(name);
+
+    return first_id;
+}
+
+template<typename Scalar>
+bool BasicMemoryEnsemble<Scalar>::has_unit(const string& name) const {
+    return _units.find(name) != UnitRegistry::npos;
+}
+
+template<typename Scalar>
+size_t BasicMemoryEnsemble<Scalar>::unit_id(const string& name) const {
+    auto id = _units.find(name);
+    if (id == UnitRegistry::npos) {
+        throw range_error(name + ": Inexistant unit name!");
+    }
+    return id;
+}
+
+template<typename Scalar>
+void BasicMemoryEnsemble<Scalar>::activate_unit(size_t member,
+                                                size_t id,
+                                                double level,
+                                                microseconds duration) {
+
+    if (!_activations_queue.push({member, id, level, duration})) {
+        _dropped_activations++;
+    }
+}
+
+template<typename Scalar>
+void BasicMemoryEnsemble<Scalar>::activate_unit(size_t member,
+                                                const string& name,
+                                                double level,
+                                                microseconds duration) {
+    activate_unit(member, unit_id(name), level, duration);
+}
+
+template<typename Scalar>
+void BasicMemoryEnsemble<Scalar>::step_n(size_t nb_steps) {
+
+    if (nb_steps == 0) return;
+
+    // If new units were added, resize the ensemble
+    // ********************************************
+
+    auto nbunits = _units.size();
+    if (nbunits > _size) resize(nbunits);
+
+    // Apply the external activations received since the last call
+    // ************************************************************
+    ExternalActivation activation;
+    while (_activations_queue.pop(activation)) {
+
+        // not a valid unit or member
+        if (activation.id >= _size || activation.member >= _nb_members) continue;
+
+        external_activations(activation.id, activation.member) = activation.level;
+        external_activations_decay(activation.id, activation.member) = activation.duration.count();
+    }
+
+    // The members are independent: rather than streaming the weights of the
+    // whole ensemble at every step, each tile of members is advanced by all
+    // the steps while its weights are in cache.
+    if (_size > 0) {
+        auto tile = max(size_t(1), ENSEMBLE_TILE_BYTES / (_size * _size * sizeof(Scalar)));
+        for (size_t first = 0; first < _nb_members; first += tile) {
+            auto last = min(first + tile, _nb_members);
+            for (size_t i = 0; i < nb_steps; i++) step(first, last);
+        }
+    }
+
+    _elapsed_time += nb_steps * _period;
+}
+
+template<typename Scalar>
+void BasicMemoryEnsemble<Scalar>::run_for(microseconds duration) {
+    if (duration <= microseconds::zero()) return;
+    step_n((duration.count() + _period.count() - 1) / _period.count());
+}
+
+template<typename Scalar>
+Scalar BasicMemoryEnsemble<Scalar>::weight(size_t member, size_t i, size_t j) const {
+
+    if (member >= _nb_members) {
+        throw out_of_range("No member " + to_string(member) + " in an ensemble of " + to_string(_nb_members));
+    }
+
+    auto col = member * _capacity + j;
+    return _connectivity(i, col) != 0 ? _weights(i, col) : NAN;
+}
+
+template<typename Scalar>
+auto BasicMemoryEnsemble<Scalar>::snapshot(size_t member) const -> shared_ptr<const Snapshot> {
+
+    if (member >= _nb_members) {
+        throw out_of_range("No member " + to_string(member) + " in an ensemble of " + to_string(_nb_members));
+    }
+
+    auto snapshot = make_shared<Snapshot>();
+
+    snapshot->time = _elapsed_time;
+    snapshot->epoch = _elapsed_time / _period;
+    snapshot->activations = _activations.col(member).head(_size);
+    snapshot->storage = WeightsStorage::Dense;
+    snapshot->dense_weights = _weights.block(0, member * _capacity, _size, _size);
+    snapshot->connectivity = _connectivity.block(0, member * _capacity, _size, _size);
+
+    return snapshot;
+}
+
+template<typename Scalar>
+void BasicMemoryEnsemble<Scalar>::set_parameter(const string& name, double value) {
+
+    if(name == "Dg") {Dg = value; return;}
+    if(name == "Lg") {Lg = value; return;}
+    if(name == "Eg") {Eg = value; return;}
+    if(name == "Ig") {Ig = value; return;}
+    if(name == "Amax") {Amax = value; return;}
+    if(name == "Amin") {Amin = value; return;}
+    if(name == "Arest") {
+        Arest = value;
+        _activations.fill(Arest);
+        return;}
+    if(name == "Winit") {Winit = value; return;}
+}
+
+template<typename Scalar>
+double BasicMemoryEnsemble<Scalar>::get_parameter(const string& name) const {
+
+    if(name == "Dg") {return Dg;}
+    if(name == "Lg") {return Lg;}
+    if(name == "Eg") {return Eg;}
+    if(name == "Ig") {return Ig;}
+    if(name == "Amax") {return Amax;}
+    if(name == "Amin") {return Amin;}
+    if(name == "Arest") {return Arest;}
+    if(name == "Winit") {return Winit;}
+
+    throw range_error(name + " is not a valid parameter name");
+}
+
+template<typename Scalar>
+void BasicMemoryEnsemble<Scalar>::step(size_t first, size_t last) {
+
+    auto n = _size;
+    auto nb = last - first;
+
+    // Establish connections
+    // *********************
+    for (size_t b = first; b < last; b++) {
+
+        auto& stimulated = _stimulated_units[b];
+        stimulated.clear();
+        for (size_t i = 0; i < n; i++) {
+            if (external_activations(i, b) != 0) stimulated.push_back(i);
+        }
+
+        auto offset = b * _capacity;
+        for (size_t k = 0; k < stimulated.size(); k++) {
+            for (size_t l = k + 1; l < stimulated.size(); l++) {
+
+                auto i = stimulated[k];
+                auto j = stimulated[l];
+                if (_connectivity(i, offset + j) != 0) continue;
+
+                _weights(i, offset + j) = _weights(j, offset + i) = Winit;
+                _connectivity(i, offset + j) = _connectivity(j, offset + i) = true;
+
+                for (auto id : {i, j}) {
+                    auto& connected = _connected_units[b];
+                    auto it = lower_bound(connected.begin(), connected.end(), id);
+                    if (it == connected.end() || *it != id) connected.insert(it, id);
+                }
+            }
+        }
+    }
+
+    // Internal activations: the non-connected units have a null weight, so
+    // only the columns of the connected units contribute, on the rows they
+    // span. They are summed by 4, to read and write the result only once.
+    for (size_t b = first; b < last; b++) {
+
+        auto internal = internal_activations.col(b).head(n);
+        internal.setZero();
+
+        const auto& connected = _connected_units[b];
+        if (connected.empty()) continue;
+
+        auto top = connected.front();
+        auto rows = connected.back() - top + 1;
+        auto weights = _weights.block(top, b * _capacity, rows, n);
+        auto result = internal.segment(top, rows);
+        const auto& a = _activations.col(b);
+
+        size_t k = 0;
+        for (; k + 4 <= connected.size(); k += 4) {
+            auto j0 = connected[k], j1 = connected[k + 1], j2 = connected[k + 2], j3 = connected[k + 3];
+            result = result + weights.col(j0) * a(j0)
+                            + weights.col(j1) * a(j1)
+                            + weights.col(j2) * a(j2)
+                            + weights.col(j3) * a(j3);
+        }
+        for (; k < connected.size(); k++) {
+            result += weights.col(connected[k]) * a(connected[k]);
+        }
+    }
+
+    // dt since last update, in (floating) milliseconds
+    Scalar dt_ms = duration_cast<duration<double, std::milli>>(_period).count();
+
+    // Activations update, for the whole tile at once
+    // **********************************************
+    auto activations = _activations.block(0, first, n, nb).array();
+    auto net_activations = (Eg * external_activations.block(0, first, n, nb).array()
+                            + Ig * internal_activations.block(0, first, n, nb).array()).eval();
+
+    activations += (net_activations > 0).select(net_activations * (Amax - activations),
+                                                net_activations * (activations - Amin));
+
+    // decay
+    activations -= Dg * dt_ms * (activations - Arest);
+
+    // clamp in [Amin, Amax]
+    activations = activations.max(Amin).min(Amax);
+
+    // Weights update
+    // **************
+    for (size_t b = first; b < last; b++) {
+
+        auto offset = b * _capacity;
+        for (auto i : _stimulated_units[b]) {
+            for (auto j : _stimulated_units[b]) {
+
+                if (_connectivity(i, offset + j) == 0) continue;
+
+                auto ai = _activations(i, b);
+                auto aj = _activations(j, b);
+                auto& w = _weights(i, offset + j);
+
+                // only update weights (ie, learn) if the units are co-activated
+                if (ai * aj > 0)
+                {
+                w += Lg * dt_ms * ai * aj * (1 - w);
+                }
+                else
+                {
+                w += Lg * dt_ms * ai * aj * (1 + w);
+                }
+            }
+        }
+    }
+
+    // decay the external activations: as in `BasicMemoryNetwork`, an
+    // activation lasts `duration / period` steps (at least one)
+    auto external = external_activations.block(0, first, n, nb).array();
+    auto decay = external_activations_decay.block(0, first, n, nb).array();
+
+    decay -= double(_period.count());
+    external = (decay > 0).select(external, Scalar(0));
+}
+
+template<typename Scalar>
+void BasicMemoryEnsemble<Scalar>::resize(size_t size) {
+
+    if (size > _capacity) {
+
+        auto capacity = max(max(size, 2 * _capacity), ENSEMBLE_MIN_CAPACITY);
+
+        auto grow_rows = [this, capacity](auto& matrix, auto value) {
+            typename remove_reference<decltype(matrix)>::type grown(capacity, _nb_members);
+            grown.fill(value);
+            grown.topRows(_size) = matrix.topRows(_size);
+            matrix.swap(grown);
+        };
+
+        grow_rows(external_activations, Scalar(0));
+        grow_rows(external_activations_decay, 0.);
+        grow_rows(internal_activations, Scalar(0));
+        grow_rows(_activations, Arest);
+
+        Matrix weights = Matrix::Zero(capacity, capacity * _nb_members);
+        ConnectivityMatrix connectivity = ConnectivityMatrix::Constant(capacity, capacity * _nb_members, false);
+        for (size_t b = 0; b < _nb_members; b++) {
+            weights.block(0, b * capacity, _size, _size) = _weights.block(0, b * _capacity, _size, _size);
+            connectivity.block(0, b * capacity, _size, _size) = _connectivity.block(0, b * _capacity, _size, _size);
+        }
+        _weights.swap(weights);
+        _connectivity.swap(connectivity);
+
+        _capacity = capacity;
+    }
+
+    // the rows past the previous size are still in their initial state
+    _size = size;
+}
+
+template class BasicMemoryEnsemble<double>;
+template class BasicMemoryEnsemble<float>;
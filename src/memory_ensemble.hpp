@@ -0,0 +1,206 @@
+#ifndef MEMORY_ENSEMBLE
+#define MEMORY_ENSEMBLE
+
+#include <Eigen/Dense>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <memory>
+
+#include "memory_network.hpp"
+#include "mpsc_queue.hpp"
+#include "unit_registry.hpp"
+
+/** An ensemble of B associative memory networks that share the same
+ * vocabulary (and the same parameters), stepped together.
+ *
+ * Each member behaves like an independent `BasicMemoryNetwork` with dense
+ * weights, running in simulated time, up to rounding: the internal
+ * activations of a member only sum the weights of its connected units.
+ *
+ * The activations of all the members are stored as one n x B matrix (one
+ * column per member), and their weights as B stacked n x n blocks. A single
+ * call to `step_n` advances the whole ensemble on the caller's thread, a
+ * tile of members at a time: the internal activations of each member are
+ * summed from the weight columns of its connected units, then the
+ * activations of the whole tile are updated at once, element-wise.
+ */
+template<typename Scalar>
+class BasicMemoryEnsemble
+{
+
+public:
+
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+    typedef BasicMemorySnapshot<Scalar> Snapshot;
+
+    /** Creates an ensemble of `nb_members` networks, initially empty.
+     *
+     * The ensemble runs in simulated time: each step advances the time by
+     * `period` (by default, 100us, ie a 10kHz network).
+     */
+    BasicMemoryEnsemble(size_t nb_members,
+                        std::chrono::microseconds period = std::chrono::microseconds(100),
+                        double Dg = 0.2,     // activation decay (per ms)
+                        double Lg = 0.01,    // learning rate (per ms)
+                        double Eg = 0.6,     // external influence
+                        double Ig = 0.3,     // internal influence
+                        double Amax = 1.0,   // maximum activation
+                        double Amin = -0.2,  // minimum activation
+                        double Arest = -0.1, // rest activation
+                        double Winit = 0.0); // initial weights
+
+    /** Resets all the members to their initial state (the vocabulary is
+     * preserved).
+     */
+    void reset();
+
+    size_t nb_members() const {return _nb_members;}
+
+    /** Adds a new unit to every member of the ensemble.
+     *
+     * Returns the internal ID of the newly created unit.
+     *
+     * Raises a `runtime_error` if the name is already in used.
+     */
+    size_t add_unit(const std::string& name);
+    size_t add_units(const std::vector<std::string>& names);
+
+    bool has_unit(const std::string& name) const;
+
+    /** Returns the internal ID of a unit.
+     *
+     * Raises a `range_error` exception is the unit does not exist.
+     */
+    size_t unit_id(const std::string& name) const;
+
+    std::vector<std::string> units_names() const {return _units.names();}
+
+    size_t size() const {return _size;}
+
+    /** Activate one unit of one member, at a specific level, for a specific
+     * duration.
+     *
+     * Can be called from any thread: the activation is queued and applied at
+     * the beginning of the next step. If the queue is full, the activation
+     * is dropped (see `dropped_activations`).
+     */
+    void activate_unit(size_t member,
+                       size_t id,
+                       double level = 1.0,
+                       std::chrono::microseconds duration = std::chrono::milliseconds(200));
+
+    void activate_unit(size_t member,
+                       const std::string& name,
+                       double level = 1.0,
+                       std::chrono::microseconds duration = std::chrono::milliseconds(200));
+
+    size_t dropped_activations() const {return _dropped_activations;}
+
+    /** Advances every member of the ensemble by `n` steps.
+     *
+     * The members are advanced by tiles that fit in cache, each tile by the
+     * `n` steps at once: the activations queued (and the units added) while
+     * `step_n` runs are only taken into account by the next call.
+     */
+    void step_n(size_t n = 1);
+
+    /** Advances every member of the ensemble by `duration` (ie,
+     * `duration / period` steps).
+     */
+    void run_for(std::chrono::microseconds duration);
+
+    std::chrono::microseconds elapsed_time() const {return _elapsed_time;}
+
+    /** Returns the activations of all the members, as a n x B matrix.
+     */
+    Matrix activations() const {return _activations.topRows(_size);}
+
+    /** Returns a snapshot of the state of one member.
+     *
+     * Raises an `out_of_range` exception if `member` is not a member of the
+     * ensemble.
+     *
+     * *Must be called from the thread stepping the ensemble.*
+     */
+    std::shared_ptr<const Snapshot> snapshot(size_t member) const;
+
+    /** Returns the weight of the connection between units `i` and `j` of
+     * one member, or NaN if they are not connected.
+     *
+     * Raises an `out_of_range` exception if `member` is not a member of the
+     * ensemble.
+     */
+    Scalar weight(size_t member, size_t i, size_t j) const;
+
+    /** See `BasicMemoryNetwork::set_parameter`.
+     */
+    void set_parameter(const std::string& name, double value);
+    double get_parameter(const std::string& name) const;
+
+    Scalar Dg;
+    Scalar Lg;
+    Scalar Eg;
+    Scalar Ig;
+    Scalar Amax;
+    Scalar Amin;
+    Scalar Arest;
+    Scalar Winit;
+
+private:
+
+    size_t _nb_members;
+    std::chrono::microseconds _period;
+    std::chrono::microseconds _elapsed_time = std::chrono::microseconds::zero();
+
+    UnitRegistry _units;
+
+    size_t _size = 0;
+    size_t _capacity = 0;
+
+    // n x B matrices (allocated for `_capacity` rows): one column per member
+    Matrix external_activations;
+    Eigen::MatrixXd external_activations_decay; // in microseconds
+    Matrix internal_activations;
+    Matrix _activations;
+
+    // B stacked blocks of `_capacity` x `_capacity` weights. The weights of
+    // member b are the block starting at column b * _capacity. As in
+    // `BasicMemoryNetwork`, non-connected units have a null weight.
+    Matrix _weights;
+    ConnectivityMatrix _connectivity;
+
+    // units that currently have a non-zero external activation, per member
+    std::vector<std::vector<size_t>> _stimulated_units;
+
+    // units that have at least one connection, per member (sorted)
+    std::vector<std::vector<size_t>> _connected_units;
+
+    struct ExternalActivation {
+        size_t member;
+        size_t id;
+        double level;
+        std::chrono::microseconds duration;
+    };
+
+    MPSCQueue<ExternalActivation> _activations_queue;
+    std::atomic<size_t> _dropped_activations{0};
+
+    /** Advances the members [first, last) by one step.
+     */
+    void step(size_t first, size_t last);
+
+    /** Conservatively increase the number of units to `size`.
+     */
+    void resize(size_t size);
+};
+
+extern template class BasicMemoryEnsemble<double>;
+extern template class BasicMemoryEnsemble<float>;
+
+typedef BasicMemoryEnsemble<double> MemoryEnsemble;
+typedef BasicMemoryEnsemble<float> MemoryEnsemblef;
+
+#endif
@@ -1,8 +1,13 @@
 #include <iostream>
+#include <fstream>
 #include <iomanip>
+#include <cmath>
+#include <cstdio> // rename
+#include <limits>
 #include <algorithm>
 #include <utility> // make_pair
 #include <iterator>
+#include <new> // placement new
 #include <ratio>
 #include <thread>
 
@@ -12,17 +17,165 @@ using namespace Eigen;
 using namespace std;
 using namespace std::chrono;
 
+// maximum number of external activations that can be queued between two
+// network steps
+const size_t ACTIVATIONS_QUEUE_CAPACITY = 4096;
+
+// minimum number of units the network is allocated for
+const size_t MIN_CAPACITY = 16;
+
+// minimum amount of work (in multiply-adds, roughly) handed to each thread
+// when stepping with several threads. Below that, waking up the threads
+// costs more than it saves.
+const size_t PARALLEL_GRAIN = 32768;
+
+/** Reallocates `vector` for `capacity` elements, preserving its first `size`
+ * elements.
+ */
+template<typename Vector>
+void grow_vector(Vector& vector, size_t size, size_t capacity) {
+    Vector grown(capacity);
+    grown.head(size) = vector.head(size);
+    vector.swap(grown);
+}
+
+/** Calls `fn(begin, end)` on consecutive blocks covering [0, count), in
+ * parallel on the `workers` threads (if any) when there is enough work.
+ * `cost` is the amount of work per element. Block boundaries are multiples of
+ * `alignment`.
+ */
+template<typename Function>
+void parallel_for(WorkerPool* workers, size_t count, size_t cost, size_t alignment, Function fn) {
+
+    if (!workers || count * cost < 2 * PARALLEL_GRAIN) {
+        fn(0, count);
+        return;
+    }
+
+    // a few blocks per thread, to balance the load
+    auto block = max((PARALLEL_GRAIN + cost - 1) / cost,
+                     (count + 4 * workers->size() - 1) / (4 * workers->size()));
+    block = (block + alignment - 1) / alignment * alignment;
+
+    auto nb_blocks = (count + block - 1) / block;
+    if (nb_blocks < 2) {
+        fn(0, count);
+        return;
+    }
+
+    workers->run(nb_blocks, [&fn, count, block](size_t i) {
+        fn(i * block, min(count, (i + 1) * block));
+    });
+}
+
+/** Returns the position of the connection to unit `id` in a sorted list of
+ * connections (or where it would be inserted if it does not exist).
+ */
+template<typename Connections>
+auto find_connection(Connections& connections, size_t id) -> decltype(connections.begin()) {
+    return lower_bound(connections.begin(), connections.end(), id,
+                       [](const typename Connections::value_type& c, size_t id) {return c.id < id;});
+}
+
+// checkpoint files start with this magic number, followed by the version of
+// the format. Values are stored in the native byte order.
+const char CHECKPOINT_MAGIC[4] = {'A', 'M', 'C', 'K'};
+const uint32_t CHECKPOINT_VERSION = 1;
+
+// same for the weights files (see `save_weights`). The weights start at an
+// offset aligned on WEIGHTS_ALIGNMENT (a page), so that they can be used
+// in place once the file is mapped in memory.
+const char WEIGHTS_MAGIC[4] = {'A', 'M', 'W', 'T'};
+const uint32_t WEIGHTS_VERSION = 1;
+const size_t WEIGHTS_ALIGNMENT = 4096;
+
+// same for the base images of the journals (see `journal`), followed by the
+// sequence number of the last step journaled in the image, then by a
+// checkpoint
+const char JOURNAL_BASE_MAGIC[4] = {'A', 'M', 'J', 'B'};
+const uint32_t JOURNAL_BASE_VERSION = 1;
+
+// while the network runs, the dense weights of a checkpoint are copied by
+// the network thread over several steps: at most this many weights per step
+// (see `serve_checkpoint_request`)
+const size_t CHECKPOINT_WEIGHTS_PER_STEP = 1 << 18;
+
+template<typename T>
+void write_values(ostream& os, const T* values, size_t count) {
+    os.write(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+template<typename T>
+void write_value(ostream& os, const T& value) {
+    write_values(os, &value, 1);
+}
+
+template<typename T>
+void read_values(istream& is, T* values, size_t count) {
+    is.read(reinterpret_cast<char*>(values), count * sizeof(T));
+    if (!is) throw runtime_error("Truncated file.");
+}
+
+template<typename T>
+T read_value(istream& is) {
+    T value;
+    read_values(is, &value, 1);
+    return value;
+}
+
+/** Returns the number of bytes left to read in `is`, so that the counts read
+ * from a file can be checked before allocating anything for them.
+ */
+size_t remaining_bytes(istream& is) {
+    auto position = is.tellg();
+    is.seekg(0, ios::end);
+    auto end = is.tellg();
+    is.seekg(position);
+    if (position < 0 || end < position) throw runtime_error("Truncated file.");
+    return size_t(end - position);
+}
+
+/** Reads a count of items stored with (at least) `item_size` bytes each,
+ * and checks that the rest of the file can hold them.
+ */
+uint64_t read_count(istream& is, size_t item_size, const string& error) {
+    auto count = read_value<uint64_t>(is);
+    if (count > remaining_bytes(is) / item_size) throw runtime_error(error);
+    return count;
+}
+
+/** Reads `count` floating point values stored with `scalar_size` bytes each
+ * (float or double), converting them to `Scalar` if needed.
+ */
+template<typename Scalar>
+void read_scalars(istream& is, Scalar* values, size_t count, uint32_t scalar_size) {
+
+    if (scalar_size == sizeof(Scalar)) {
+        read_values(is, values, count);
+        return;
+    }
+
+    auto convert = [&is, values, count](auto stored) {
+        vector<decltype(stored)> buffer(count);
+        read_values(is, buffer.data(), count);
+        copy(buffer.begin(), buffer.end(), values);
+    };
+
+    if (scalar_size == sizeof(float)) convert(float());
+    else convert(double());
+}
 
-MemoryNetwork::MemoryNetwork(LoggingFunction activations_log_fn,
-                             LoggingFunction external_activations_log_fn,
-                             double Dg,   
-                             double Lg,   
-                             double Eg,   
-                             double Ig,   
-                             double Amax, 
-                             double Amin, 
-                             double Arest,
-                             double Winit) :
+template<typename Scalar>
+BasicMemoryNetwork<Scalar>::BasicMemoryNetwork(LoggingFunction activations_log_fn,
+                                               LoggingFunction external_activations_log_fn,
+                                               double Dg,
+                                               double Lg,
+                                               double Eg,
+                                               double Ig,
+                                               double Amax,
+                                               double Amin,
+                                               double Arest,
+                                               double Winit) :
                 Dg(Dg),   
                 Lg(Lg),
                 Eg(Eg),
@@ -33,13 +186,17 @@ MemoryNetwork::MemoryNetwork(LoggingFunction activations_log_fn,
                 Winit(Winit),
                 _log_activation(activations_log_fn),
                 _log_external_activation(external_activations_log_fn),
-                gen(rd())
+                gen(rd()),
+                _activations_queue(ACTIVATIONS_QUEUE_CAPACITY)
 {
 
     reset();
 }
 
-void MemoryNetwork::reset() {
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::reset() {
+
+    if (_journal) throw runtime_error("Can not reset the network while journaling.");
 
     rest_activations.fill(Arest);
 
@@ -48,96 +205,455 @@ void MemoryNetwork::reset() {
     net_activations.fill(0);
 
     _activations.fill(Arest);
-    _weights.fill(NAN);
+    if (_mapped_weights) {
+        // zeroing the mapped weights would copy all of them anyway
+        allocate_weights(_capacity);
+    }
+    else {
+        _weights.fill(0);
+        _connectivity.fill(false);
+    }
+    for (auto& connections : _sparse_weights) connections.clear();
+
+    // restart the clock, and forget the scheduled activations
+    if (!_is_running) {
+        _is_started = false;
+        _timers.clear();
+    }
+
+    // all the units are now at rest
+    _active_units.clear();
+    _is_active.assign(_is_active.size(), false);
+    _has_connections.assign(_has_connections.size(), false);
 
 }
 
-void MemoryNetwork::compute_internal_activations() {
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::wakeup(size_t id) {
+    if (_is_active[id]) return;
+    _is_active[id] = true;
+    _active_units.push_back(id);
+}
 
-    for (size_t i = 0; i < size(); i++)
-    {
-        double sum = 0;
-        for (size_t j = 0; j < size(); j++)
-        {
-            if (std::isnan(_weights(i,j))) continue;
-            sum += _weights(i, j) * _activations(j);
-        }
-        internal_activations(i) = sum;
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::compute_internal_activations() {
+
+    if (_weights_storage == WeightsStorage::Sparse) {
+        // sleeping units have no connection: their internal activation is 0
+        parallel_for(_workers.get(), _active_units.size(), 4, 1, [this](size_t begin, size_t end) {
+            for (auto k = begin; k < end; k++)
+            {
+                auto i = _active_units[k];
+                Scalar sum = 0;
+                for (const auto& c : _sparse_weights[i]) {
+                    sum += c.weight * _activations(c.id);
+                }
+                internal_activations(i) = sum;
+            }
+        });
+        return;
     }
+
+    // non-connected units have a null weight: no need to mask them out.
+    // Each row block is a separate product, computed with exactly the same
+    // operations as the whole one, as long as the blocks are aligned on the
+    // (vectorized) kernel's row chunks.
+    parallel_for(_workers.get(), size(), size(), 64, [this](size_t begin, size_t end) {
+        internal_activations.segment(begin, end - begin).noalias() = _weights.block(begin, 0, end - begin, size())
+                                                                   * _activations.head(size());
+    });
 }
 
-void MemoryNetwork::activate_unit(const string& unit,
-                                  double level,
-                                  microseconds duration) {
-    auto id = unit_id(unit);
-    activate_unit(id, level, duration);
+template<typename Scalar>
+bool BasicMemoryNetwork<Scalar>::connected(size_t i, size_t j) const {
+
+    if (_weights_storage == WeightsStorage::Dense) {
+        return _connectivity(i,j) != 0;
+    }
+
+    const auto& connections = _sparse_weights[i];
+    auto it = find_connection(connections, j);
+    return it != connections.end() && it->id == j;
 }
 
-void MemoryNetwork::activate_unit(size_t id,
-                                  double level,
-                                  microseconds duration) {
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::connect(size_t i, size_t j) {
+
+    _has_connections[i] = _has_connections[j] = true;
+    wakeup(i);
+    wakeup(j);
+
+    if (_weights_storage == WeightsStorage::Dense) {
+        _weights(i,j) = _weights(j,i) = Winit;
+        _connectivity(i,j) = _connectivity(j,i) = true;
+        return;
+    }
+
+    auto insert = [this](size_t from, size_t to) {
+        auto& connections = _sparse_weights[from];
+        connections.insert(find_connection(connections, to), {to, Winit});
+    };
+    insert(i, j);
+    insert(j, i);
+}
+
+template<typename Scalar>
+Scalar BasicMemoryNetwork<Scalar>::weight(size_t i, size_t j) const {
 
-    // the excited unit has recently been added, and the network update thread has not yet resized the network. Skip this excitation 
-    if (id >= size()) return;
+    if (_weights_storage == WeightsStorage::Dense) {
+        return _connectivity(i,j) != 0 ? _weights(i,j) : NAN;
+    }
+
+    const auto& connections = _sparse_weights[i];
+    auto it = find_connection(connections, j);
+    if (it != connections.end() && it->id == j) return it->weight;
+    return NAN;
+}
+
+template<typename Scalar>
+auto BasicMemoryNetwork<Scalar>::weights() const -> Matrix {
 
-    if(_is_recording) {
-        auto now = elapsed_time();
+    if (_weights_storage == WeightsStorage::Dense) {
+        return _connectivity.topLeftCorner(size(), size())
+                            .select(_weights.topLeftCorner(size(), size()),
+                                    Matrix::Constant(size(), size(), NAN));
+    }
 
-        if (_activations_history[id].empty()) {
-            _activations_history[id].push_back(make_tuple(level, now, duration));
+    Matrix weights = Matrix::Constant(size(), size(), NAN);
+    for (size_t i = 0; i < size(); i++) {
+        for (const auto& c : _sparse_weights[i]) {
+            weights(i, c.id) = c.weight;
         }
-        else {
-            // check if we can merge with the last record
+    }
+    return weights;
+}
+
+template<typename Scalar>
+auto BasicMemoryNetwork<Scalar>::snapshot() const -> shared_ptr<const Snapshot> {
+    return atomic_load(&_snapshot);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::publish_snapshots(bool enabled, microseconds period) {
+    _publish_snapshots = enabled;
+    _snapshots_period = period;
+    _last_snapshot_time = elapsed_time();
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::publish_snapshot() {
+
+    shared_ptr<Snapshot> snapshot;
+
+    // recycle the previous snapshot if no reader holds it anymore
+    if (_spare_snapshot && _spare_snapshot.use_count() == 1) {
+        // make sure the readers are done with it before overwriting it
+        atomic_thread_fence(memory_order_acquire);
+        snapshot = move(_spare_snapshot);
+    }
+    else {
+        snapshot = make_shared<Snapshot>();
+    }
+
+    snapshot->epoch = _epoch;
+    snapshot->time = elapsed_time();
+    snapshot->activations = _activations.head(size());
+    snapshot->storage = _weights_storage;
+
+    if (_weights_storage == WeightsStorage::Sparse) {
+        snapshot->sparse_weights = _sparse_weights;
+    }
+    else {
+        snapshot->dense_weights = _weights.topLeftCorner(size(), size());
+        snapshot->connectivity = _connectivity.topLeftCorner(size(), size());
+    }
+
+    auto previous = atomic_exchange(&_snapshot, shared_ptr<const Snapshot>(snapshot));
+    _spare_snapshot = const_pointer_cast<Snapshot>(previous);
+}
+
+template<typename Scalar>
+Scalar BasicMemorySnapshot<Scalar>::weight(size_t i, size_t j) const {
+
+    if (storage == WeightsStorage::Dense) {
+        return connectivity(i,j) != 0 ? dense_weights(i,j) : NAN;
+    }
+
+    const auto& connections = sparse_weights[i];
+    auto it = find_connection(connections, j);
+    if (it != connections.end() && it->id == j) return it->weight;
+    return NAN;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::integrator(Integrator integrator, microseconds reference_period) {
 
-            chrono::microseconds lasttime,lastduration;
-            float lastlevel;
-            tie(lastlevel, lasttime,lastduration) = _activations_history[id].back();
+    if (_is_running) throw runtime_error("Can not change the integrator once the network is running.");
 
-            if (lasttime + lastduration < now) { // no overlap with previous, good.
-                _activations_history[id].push_back(make_tuple(level, now, duration));
+    if (reference_period <= microseconds::zero()) {
+        throw runtime_error("The reference period of the integrator must be strictly positive.");
+    }
+
+    _integrator = integrator;
+    _reference_period_ms = duration_cast<duration<double, std::milli>>(reference_period).count();
+}
+
+template<typename Scalar>
+Scalar BasicMemoryNetwork<Scalar>::integrate_activation(Scalar activation,
+                                                         Scalar net,
+                                                         Scalar rest,
+                                                         Scalar dt_ms) const {
+
+    // no input: plain exponential decay towards the rest activation
+    if (net == 0) return rest + (activation - rest) * exp(-Dg * dt_ms);
+
+    // otherwise, exponential relaxation towards the equilibrium between the
+    // input (pulling towards Amax or Amin) and the decay
+    auto rate = abs(net) / _reference_period_ms;
+    auto target = net > 0 ? Amax : Amin;
+
+    auto k = rate + Dg;
+    auto equilibrium = (rate * target + Dg * rest) / k;
+
+    return equilibrium + (activation - equilibrium) * exp(-k * dt_ms);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::weights_storage(WeightsStorage storage) {
+
+    if (_is_running) throw runtime_error("Can not change the weights storage once the network is running.");
+
+    if (storage == _weights_storage) return;
+
+    if (storage == WeightsStorage::Sparse) {
+        _sparse_weights.assign(size(), {});
+        for (size_t i = 0; i < size(); i++) {
+            for (size_t j = 0; j < size(); j++) {
+                if (_connectivity(i,j) == 0) continue;
+                _sparse_weights[i].push_back({j, _weights(i,j)});
             }
-            else {
-                if (level != lastlevel) { // trim previous record, and add new one
-                    _activations_history[id].back() = make_tuple(lastlevel, lasttime, now - lasttime);
-                    _activations_history[id].push_back(make_tuple(level, now, duration));
-                }
-                else { // same levels: merge!
-                    _activations_history[id].back() = make_tuple(level, lasttime, now + duration - lasttime);
-                }
+        }
+        allocate_weights(0);
+    }
+    else {
+        allocate_weights(_capacity);
+        for (size_t i = 0; i < size(); i++) {
+            for (const auto& c : _sparse_weights[i]) {
+                _weights(i, c.id) = c.weight;
+                _connectivity(i, c.id) = true;
             }
         }
+        _sparse_weights.clear();
+    }
+
+    _weights_storage = storage;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::activate_unit(const string& unit,
+                                  double level,
+                                  microseconds duration,
+                                  microseconds at_time) {
+    auto id = unit_id(unit);
+    activate_unit(id, level, duration, at_time);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::activate_unit(const char* name,
+                                  size_t length,
+                                  double level,
+                                  microseconds duration,
+                                  microseconds at_time) {
+    auto id = unit_id(name, length);
+    activate_unit(id, level, duration, at_time);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::activate_unit(size_t id,
+                                  double level,
+                                  microseconds duration,
+                                  microseconds at_time) {
+
+    auto pushed = _activations_queue.push({id, level, duration, elapsed_time(), at_time});
+
+    if (_tracing.load(memory_order_acquire)) {
+        _tracer->instant(pushed ? "activate_unit" : "activate_unit (dropped)", "unit", id);
+    }
+
+    if (!pushed) {
+        _dropped_activations++;
+        return;
+    }
+
+    notify_activity();
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::schedule_activation(const string& unit,
+                                                     double level,
+                                                     microseconds duration,
+                                                     microseconds at_time) {
+    schedule_activation(unit_id(unit), level, duration, at_time);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::schedule_activation(size_t id,
+                                                     double level,
+                                                     microseconds duration,
+                                                     microseconds at_time) {
+
+    if (_is_running) {
+        activate_unit(id, level, duration, at_time);
+        return;
+    }
+
+    if (id >= _units.size()) {
+        throw range_error("Unit " + to_string(id) + ": Inexistant unit ID!");
+    }
+
+    // the timers are rewound by the current time of the wheel at the next
+    // start (see `init_time`)
+    auto time = _is_started ? at_time : microseconds(_timers.now()) + at_time;
+
+    _timers.schedule(time.count(), {{id, level, duration, elapsed_time(), at_time}, false});
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::apply_activation(const ExternalActivation& activation,
+                                                  microseconds now) {
+
+    auto id = activation.id;
+
+    if (_is_recording) record_activation(activation, now);
+    if (_recorder) _recorder->push({id, activation.level, now, activation.duration});
+
+    external_activations(id) = activation.level;
+    wakeup(id);
+
+    auto expiry = now + activation.duration;
+    external_activations_expiry(id) = expiry.count();
+    _timers.schedule(expiry.count(), {activation, true});
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::record_activation(const ExternalActivation& activation,
+                                                   microseconds now) {
+    _unrecorded_activations.push_back(activation);
+    _unrecorded_activations.back().time = now;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::flush_recorded_activations(bool wait) {
+
+    unique_lock<mutex> lock(_activations_history_mutex, defer_lock);
+    if (wait) lock.lock();
+    else if (!lock.try_lock()) return; // a query is running: retried at the next step
+
+    for (const auto& activation : _unrecorded_activations) {
+        _activations_history.add(activation.id, activation.level, activation.time, activation.duration);
     }
+    _unrecorded_activations.clear();
+}
+
+template<typename Scalar>
+vector<ActivationInterval> BasicMemoryNetwork<Scalar>::recorded_activations(size_t id,
+                                                                            microseconds begin,
+                                                                            microseconds end) const {
+    lock_guard<mutex> lock(_activations_history_mutex);
+    return _activations_history.intervals(id, begin, end);
+}
 
+template<typename Scalar>
+float BasicMemoryNetwork<Scalar>::recorded_input(size_t id, microseconds time) const {
+    lock_guard<mutex> lock(_activations_history_mutex);
+    return _activations_history.level(id, time);
+}
+
+template<typename Scalar>
+vector<size_t> BasicMemoryNetwork<Scalar>::externally_active_units(microseconds begin,
+                                                                   microseconds end) const {
+    lock_guard<mutex> lock(_activations_history_mutex);
+    return _activations_history.active_units(begin, end);
+}
+
+template<typename Scalar>
+vector<pair<size_t, microseconds>> BasicMemoryNetwork<Scalar>::co_activated_units(size_t id,
+                                                                                   microseconds begin,
+                                                                                   microseconds end) const {
+    lock_guard<mutex> lock(_activations_history_mutex);
+    return _activations_history.co_occurrences(id, begin, end);
+}
 
-    external_activations(id) = level;
-    external_activations_decay(id) = duration.count();
+template<typename Scalar>
+size_t BasicMemoryNetwork<Scalar>::unit_id(const std::string& name) const {
+    return unit_id(name.data(), name.size());
 }
 
-size_t MemoryNetwork::unit_id(const std::string& name) const {
-    size_t i = 0;
-    for ( ; i < _units_names.size(); i++) {
-        if (_units_names[i] == name) return i;
+template<typename Scalar>
+size_t BasicMemoryNetwork<Scalar>::unit_id(const char* name, size_t length) const {
+    auto id = _units.find(name, length);
+    if (id == UnitRegistry::npos) {
+        throw range_error(string(name, length) + ": Inexistant unit name!");
     }
-    throw range_error(name + ": Inexistant unit name!");
+    return id;
 }
 
-size_t MemoryNetwork::add_unit(const std::string& name) {
+template<typename Scalar>
+size_t BasicMemoryNetwork<Scalar>::add_unit(const std::string& name) {
 
     cerr << "Adding unit " << name << endl;
+
     if (has_unit(name)) {
         throw runtime_error(name + " is already used. Two units can not have the same name.");
     }
 
-    _units_names.push_back(name);
+    // the network thread steps the unit as soon as it is in `_units`: the
+    // journal and the recorder must know it by then, to write it before
+    // its weights and activations
+    auto id = _units.size();
+    if (_journal) _journal->add_units(id, {name});
+    if (_recorder) _recorder->add_units(id, {name});
+    _units.add(name);
+
+    notify_activity();
+    return id;
+}
+
+template<typename Scalar>
+size_t BasicMemoryNetwork<Scalar>::add_units(const std::vector<std::string>& names) {
+
+    cerr << "Adding " << names.size() << " units" << endl;
+
+    // check all the names first (against the network and among themselves),
+    // so that either all the units are added, or none
+    UnitRegistry batch;
+    batch.reserve(names.size());
+    for (const auto& name : names) {
+        if (has_unit(name)) {
+            throw runtime_error(name + " is already used. Two units can not have the same name.");
+        }
+        batch.add(name);
+    }
+
+    // registered with the journal and the recorder first (see `add_unit`)
+    auto first_id = _units.size();
+    if (_journal) _journal->add_units(first_id, names);
+    if (_recorder) _recorder->add_units(first_id, names);
 
-    return _units_names.size();
+    _units.reserve(first_id + names.size());
+    for (const auto& name : names) _units.add(name);
+
+    notify_activity();
+    return first_id;
 }
 
-bool MemoryNetwork::has_unit(const std::string& name) const {
-    return (find(_units_names.begin(), _units_names.end(), name) != _units_names.end());
+template<typename Scalar>
+bool BasicMemoryNetwork<Scalar>::has_unit(const std::string& name) const {
+    return _units.find(name) != UnitRegistry::npos;
 }
 
-void MemoryNetwork::set_parameter(const std::string& name, double value) {
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::set_parameter(const std::string& name, double value) {
 
     if (_is_running) throw runtime_error("Can not change the network parameters once the network is running.");
 
@@ -157,7 +673,8 @@ void MemoryNetwork::set_parameter(const std::string& name, double value) {
     if(name == "Winit") {Winit = value; return;}
 }
 
-void MemoryNetwork::max_frequency(double freq) {
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::max_frequency(double freq) {
 
     if (_is_running) throw runtime_error("Can not change the network parameters once the network is running.");
 
@@ -174,19 +691,35 @@ void MemoryNetwork::max_frequency(double freq) {
     cerr << "Setting the internal minimal period to " << duration_cast<microseconds>(_min_period).count() << "us" << endl;
 }
 
-microseconds MemoryNetwork::elapsed_time() const
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::threads(size_t nb_threads) {
+
+    if (_is_running) throw runtime_error("Can not change the number of threads once the network is running.");
+
+    if (nb_threads == 0) nb_threads = max(1u, thread::hardware_concurrency());
+
+    if (nb_threads == threads()) return;
+
+    _workers.reset(nb_threads > 1 ? new WorkerPool(nb_threads) : nullptr);
+
+    cerr << "Stepping the network with " << nb_threads << " thread(s)" << endl;
+}
+
+template<typename Scalar>
+microseconds BasicMemoryNetwork<Scalar>::elapsed_time() const
 {
-    if (!_is_running) return microseconds::zero();
+    if (!_is_started) return microseconds::zero();
 
     if(_use_physical_time) {
-        return duration_cast<microseconds>(high_resolution_clock::now() - _start_time);
+        return duration_cast<microseconds>(now() - _start_time);
     }
     else {
         return _elapsed_time;
     }
 }
 
-double MemoryNetwork::get_parameter(const std::string& name) const {
+template<typename Scalar>
+double BasicMemoryNetwork<Scalar>::get_parameter(const std::string& name) const {
 
     if(name == "Dg") {return Dg;}
     if(name == "Lg") {return Lg;}
@@ -200,9 +733,10 @@ double MemoryNetwork::get_parameter(const std::string& name) const {
     throw range_error(name + " is not a valid parameter name");
 }
 
-void MemoryNetwork::start() {
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::start() {
 
-    _network_thread = thread(&MemoryNetwork::run, this);
+    _network_thread = thread(&BasicMemoryNetwork::run, this);
 
     // wait for the thread to be effectively running
     while(!_is_running) {
@@ -210,39 +744,154 @@ void MemoryNetwork::start() {
     };
 }
 
-void MemoryNetwork::stop() {
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::stop() {
 
     _is_running = false;
+    notify_activity();
     _network_thread.join();
+    _is_started = false;
+
+    apply_pending_histories();
+    flush_recorded_activations(true);
 }
 
-void MemoryNetwork::run() {
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::step_n(size_t n) {
 
+    if (_is_running) throw runtime_error("Can not manually step the network while the network thread is running.");
 
-    cerr << "Memory network thread started." << endl;
-    _start_time = _last_timestamp = _last_freq_computation = high_resolution_clock::now();
+    if (!_is_started) init_time();
+
+    for (size_t i = 0; i < n; i++) step();
+
+    flush_recorded_activations(true);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::run_for(microseconds duration) {
+
+    if (_is_running) throw runtime_error("Can not manually step the network while the network thread is running.");
+
+    if (!_use_physical_time && _min_period == microseconds::zero()) {
+        throw runtime_error("A maximum frequency must be set to run the network in simulated time.");
+    }
+
+    if (!_is_started) init_time();
+
+    auto end = elapsed_time() + duration;
+    while (elapsed_time() < end) step();
+
+    flush_recorded_activations(true);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::clock(ClockFunction clock) {
+
+    if (_is_running) throw runtime_error("Can not change the clock once the network is running.");
+
+    _clock = clock;
+}
+
+template<typename Scalar>
+high_resolution_clock::time_point BasicMemoryNetwork<Scalar>::now() const {
+    return _clock ? _clock() : high_resolution_clock::now();
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::init_time() {
+
+    _start_time = _last_timestamp = _last_freq_computation = now();
+    _deadline = _start_time;
 
     _elapsed_time = microseconds::zero();
+    _epoch = 0;
+    _last_snapshot_time = microseconds::zero();
+
+    // the pending timers (if restarting after `stop`) keep their remaining
+    // delay
+    external_activations_expiry.head(size()).array() -= _timers.now();
+    _timers.rewind();
+
+    _is_started = true;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::run() {
+
+
+    cerr << "Memory network thread started." << endl;
+    init_time();
+
+    {
+        lock_guard<mutex> lock(_checkpoint_mutex);
+        _serving_checkpoints = true;
+    }
 
     _is_running = true;
-    while(_is_running) step();
+    while(_is_running) {
+        step();
+        if (_checkpoint_requested.load(memory_order_relaxed)) serve_checkpoint_request();
+        if (_idle_mode && _use_physical_time && !_clock && is_quiescent()) {
+            auto idle_start = steady_clock::now();
+            idle();
+            if (_tracing.load(memory_order_acquire)) {
+                _tracer->complete("idle", idle_start, steady_clock::now());
+            }
+        }
+    }
+
+    // no new request can be made from now on: serve the last one, if any
+    {
+        lock_guard<mutex> lock(_checkpoint_mutex);
+        _serving_checkpoints = false;
+    }
+    serve_checkpoint_request(true);
+
     cerr << "Memory network finished." << endl;
 
 }
 
-void MemoryNetwork::step()
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::step()
 {
 
     microseconds dt;
+    microseconds step_time; // network time of this step
+
+    auto paced = is_paced();
+
+    auto profiling = _profiling.load(memory_order_relaxed);
+    auto tracing = _tracing.load(memory_order_acquire);
+
+    auto step_start = (profiling || tracing) ? steady_clock::now() : steady_clock::time_point();
+    auto phase_start = step_start;
+    auto end_phase = [this, profiling, tracing, &phase_start](StepPhase phase) {
+        if (!profiling && !tracing) return;
+        auto now = steady_clock::now();
+        if (profiling) _phase_durations[static_cast<size_t>(phase)] += now - phase_start;
+        if (tracing) _tracer->complete(StepProfile::phase_name(phase), phase_start, now);
+        phase_start = now;
+    };
+    auto end_step = [this, profiling, tracing, step_start]() {
+        if (profiling) record_step_profile();
+        if (tracing) _tracer->complete("step", step_start, steady_clock::now(), "epoch", _epoch);
+    };
+    if (tracing) _tracer->name_thread("network");
 
     if (_use_physical_time)
     {
+        if (paced) wait_for_deadline();
+
         // Compute dt
-        auto now = high_resolution_clock::now();
+        auto now = this->now();
         dt = duration_cast<microseconds>(now - _last_timestamp);
         _last_timestamp = now;
+        step_time = duration_cast<microseconds>(now - _start_time);
 
-        if (   _min_period != microseconds::zero()
+        if (   !_clock
+                && !paced
+                && _min_period != microseconds::zero()
                 && dt < _min_period) {
             this_thread::sleep_for(_min_period - dt);
         }
@@ -263,112 +912,1384 @@ void MemoryNetwork::step()
     else
     {
         dt = _min_period;
-        _elapsed_time += dt;
+        step_time = _elapsed_time.load() + dt;
+        _elapsed_time = step_time;
     }
+    end_phase(StepPhase::Pacing);
 
     // If new units were added, resize the network
     // *******************************************
     
-    auto nbunits = _units_names.size();
-    for(size_t i=size();i<nbunits;i++) incrementsize();
+    if (_requested_capacity > _capacity) {
+        auto start = tracing ? steady_clock::now() : steady_clock::time_point();
+        grow(_requested_capacity);
+        if (tracing) _tracer->complete("grow capacity", start, steady_clock::now(), "capacity", _capacity);
+    }
+
+    auto nbunits = _units.size();
+    if (nbunits > size()) {
+        auto start = tracing ? steady_clock::now() : steady_clock::time_point();
+        resize(nbunits);
+        if (tracing) _tracer->complete("add units", start, steady_clock::now(), "units", nbunits);
+    }
+
+    apply_pending_histories();
+
+    end_phase(StepPhase::Resize);
+
+    if (size() == 0) {
+        if (paced) complete_paced_step();
+        end_step();
+        return;
+    }
+
+    // Fire the timers due (expiries and scheduled activations)
+    // ********************************************************
+    _timers.advance(step_time.count(), [this, step_time](uint64_t time, const TimerEvent& event) {
+        auto id = event.activation.id;
+
+        if (!event.expiry) {
+            apply_activation(event.activation, step_time);
+        }
+        else if (external_activations_expiry(id) == time) {
+            external_activations(id) = 0;
+        }
+    });
+
+    // Apply the external activations received since the last step
+    // ************************************************************
+    auto drain_start = tracing ? steady_clock::now() : steady_clock::time_point();
+    size_t nb_drained = 0;
+
+    ExternalActivation activation;
+    while (_activations_queue.pop(activation)) {
 
-    if (size() == 0) return;
+        nb_drained++;
+
+        // not a valid unit
+        if (activation.id >= size()) continue;
+
+        if (activation.at_time > step_time) {
+            _timers.schedule(activation.at_time.count(), {activation, false});
+        }
+        else {
+            apply_activation(activation, step_time);
+        }
+    }
+    if (tracing && nb_drained) {
+        _tracer->complete("activations queue", drain_start, steady_clock::now(), "activations", nb_drained);
+    }
+    if (!_unrecorded_activations.empty()) flush_recorded_activations(false);
+    end_phase(StepPhase::ExternalActivations);
 
     // Establish connections
     // *********************
 
-    for (size_t i = 0; i < external_activations.size() - 1; i++) {
-
-        if (external_activations(i) == 0) continue;
+    // units with an external activation are always active
+    _stimulated_units.clear();
+    for (auto i : _active_units) {
+        if (external_activations(i) != 0) _stimulated_units.push_back(i);
+    }
 
-        for (size_t j = i + 1; j < external_activations.size(); j++) {
+    // only the weights between stimulated units change below: the checkpoint
+    // being captured gets their previous values first
+    if (_capture) {
+        for (auto j : _stimulated_units) capture_weights_column(j);
+    }
 
-            if (external_activations(j) == 0) continue;
+    for (size_t k = 0; k < _stimulated_units.size(); k++) {
+        for (size_t l = k + 1; l < _stimulated_units.size(); l++) {
 
-            if (std::isnan(_weights(i,j))) {
-                    _weights(i,j) = _weights(j,i) = Winit;
-            }
+            auto i = _stimulated_units[k];
+            auto j = _stimulated_units[l];
+            if (!connected(i, j)) connect(i, j);
         }
     }
+    end_phase(StepPhase::Connections);
 
     compute_internal_activations();
+    end_phase(StepPhase::InternalActivations);
 
-    net_activations = Eg * external_activations + Ig * internal_activations;
+    // dt since last update, in (floating) milliseconds
+    Scalar dt_ms = duration_cast<duration<double, std::milli>>(dt).count();
 
     // Activations update
     // ******************
-    for (size_t i = 0; i < size(); i++)
+    parallel_for(_workers.get(), _active_units.size(), 8, 1, [this, dt_ms](size_t begin, size_t end) {
+    for (auto k = begin; k < end; k++)
     {
+        auto i = _active_units[k];
+        auto previous_activation = _activations(i);
 
-        if (net_activations(i) > 0)
-            _activations(i) +=  net_activations(i) * (Amax - _activations(i));
-        else
-            _activations(i) +=  net_activations(i) * (_activations(i) - Amin);
+        net_activations(i) = Eg * external_activations(i) + Ig * internal_activations(i);
 
-    }
-    
-    // dt since last update, in (floating) milliseconds
-    double dt_ms = duration_cast<duration<double, std::milli>>(dt).count();
+        if (_integrator == Integrator::Exponential) {
+            _activations(i) = integrate_activation(_activations(i),
+                                                   net_activations(i),
+                                                   rest_activations(i),
+                                                   dt_ms);
+        }
+        else {
+            if (net_activations(i) > 0)
+                _activations(i) +=  net_activations(i) * (Amax - _activations(i));
+            else
+                _activations(i) +=  net_activations(i) * (_activations(i) - Amin);
 
-    // decay
-    _activations -= Dg * dt_ms * (_activations - rest_activations);
+            // decay
+            _activations(i) -= Dg * dt_ms * (_activations(i) - rest_activations(i));
+        }
 
-    for (size_t i = 0; i < size(); i++)
-    {
         // clamp in [Amin, Amax]
         _activations(i) = min(Amax, max(Amin, _activations(i)));
+
+        // put the unit to sleep if nothing can change its activation anymore
+        if (   external_activations(i) == 0
+            && !_has_connections[i]
+            && _activations(i) == previous_activation) {
+            _is_active[i] = false;
+        }
     }
+    });
+    end_phase(StepPhase::ActivationsUpdate);
 
     // if necessary, log the activations and external stimulations
     auto elapsed_time_so_far = elapsed_time();
     if(_log_activation) {
-        _log_activation(elapsed_time_so_far, _activations);
+        auto start = tracing ? steady_clock::now() : steady_clock::time_point();
+        _log_activation(elapsed_time_so_far, _activations.head(size()));
+        if (tracing) _tracer->complete("activations log callback", start, steady_clock::now());
     }
     if(_log_external_activation) {
+        auto start = tracing ? steady_clock::now() : steady_clock::time_point();
         _log_external_activation(elapsed_time_so_far,
-                                 external_activations);
+                                 external_activations.head(size()));
+        if (tracing) _tracer->complete("external activations log callback", start, steady_clock::now());
+    }
+    if (_activations_sink) {
+        _activations_sink->push(elapsed_time_so_far, _activations.head(size()));
     }
+    if (_external_activations_sink) {
+        _external_activations_sink->push(elapsed_time_so_far, external_activations.head(size()));
+    }
+    if (_history) {
+        _history->push(elapsed_time_so_far, _activations.head(size()));
+    }
+    if (_external_history) {
+        _external_history->push(elapsed_time_so_far, external_activations.head(size()));
+    }
+    if (_recorder) {
+        _recorder->push(elapsed_time_so_far, _activations.head(size()));
+    }
+    end_phase(StepPhase::Logging);
 
     // Weights update
     // **************
-    for (size_t i = 0; i < size(); i++)
+    update_weights(dt_ms);
+    if (_journal) journal_weights();
+    end_phase(StepPhase::WeightsUpdate);
+
+    _active_units.erase(remove_if(_active_units.begin(), _active_units.end(),
+                                  [this](size_t i) {return !_is_active[i];}),
+                        _active_units.end());
+
+    _epoch++;
+
+    // if needed, publish a snapshot of the new state
+    if (_publish_snapshots
+        && (_epoch == 1 || elapsed_time_so_far - _last_snapshot_time >= _snapshots_period)) {
+        _last_snapshot_time = elapsed_time_so_far;
+        publish_snapshot();
+    }
+    end_phase(StepPhase::Snapshot);
+
+    if (paced) complete_paced_step();
+    end_step();
+}
+
+template<typename Scalar>
+bool BasicMemoryNetwork<Scalar>::is_paced() const {
+    return _fixed_rate
+        && _use_physical_time
+        && !_clock
+        && _min_period != microseconds::zero();
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::wait_for_deadline() {
+
+    auto now = this->now();
+
+    if (now < _deadline) {
+        if (_spin > microseconds::zero()) {
+            this_thread::sleep_until(_deadline - _spin);
+            while (this->now() < _deadline) {}
+        }
+        else {
+            this_thread::sleep_until(_deadline);
+        }
+        now = this->now();
+    }
+
+    auto missed = (now - _deadline) / _min_period;
+    _deadline += missed * _min_period;
+
+    lock_guard<mutex> lock(_pacing_stats_mutex);
+
+    auto jitter = duration_cast<nanoseconds>(now - _deadline);
+    _pacing_stats.steps++;
+    _pacing_stats.missed_deadlines += missed;
+    _pacing_stats.total_jitter += jitter;
+    _pacing_stats.max_jitter = max(_pacing_stats.max_jitter, jitter);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::complete_paced_step() {
+
+    auto latency = duration_cast<microseconds>(now() - _deadline).count();
+
+    size_t bin = 0;
+    while (latency > 1 && bin < PacingStats::HISTOGRAM_BINS - 1) {
+        latency >>= 1;
+        bin++;
+    }
+
     {
-        for (size_t j = 0; j < size(); j++)
-        {
-            if (std::isnan(_weights(i,j))) continue;
+        lock_guard<mutex> lock(_pacing_stats_mutex);
+        _pacing_stats.latency_histogram[bin]++;
+    }
+
+    _deadline += _min_period;
+}
 
-            // only update weights (ie, learn) if the units are co-activated
-            if (external_activations(i) * external_activations(j) == 0) continue;
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::fixed_rate(bool enabled, microseconds spin) {
 
-            if (_activations(i) * _activations(j) > 0)
-            {
-            _weights(i,j) += Lg * dt_ms * _activations(i) * _activations(j) * (1 - _weights(i,j));
+    if (_is_running) throw runtime_error("Can not change the pacing once the network is running.");
+
+    _fixed_rate = enabled;
+    _spin = spin;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::idle_mode(bool enabled, double epsilon) {
+
+    if (_is_running) throw runtime_error("Can not change the idle mode once the network is running.");
+
+    _idle_mode = enabled;
+    _idle_epsilon = epsilon;
+}
+
+template<typename Scalar>
+bool BasicMemoryNetwork<Scalar>::is_quiescent() const {
+
+    // sleeping units are exactly at rest, without input
+    for (auto i : _active_units) {
+        if (external_activations(i) != 0) return false;
+        if (abs(_activations(i) - rest_activations(i)) > _idle_epsilon) return false;
+    }
+    return true;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::idle() {
+
+    auto idle_start = now();
+
+    {
+        unique_lock<mutex> lock(_idle_mutex);
+        _is_idle = true;
+
+        // pairs with the fence in `notify_activity`: either the producer
+        // sees `_is_idle` and notifies, or we see its work below.
+        atomic_thread_fence(memory_order_seq_cst);
+
+        auto has_work = [this]() {
+            return !_is_running
+                || !_activations_queue.empty()
+                || _units.size() > size()
+                || _requested_capacity > _capacity
+                || _checkpoint_requested; // (possibly being captured)
+        };
+
+        auto next_timer = _timers.next_time();
+        if (next_timer == numeric_limits<decltype(next_timer)>::max()) {
+            _idle_condition.wait(lock, has_work);
+        }
+        else {
+            _idle_condition.wait_until(lock, _start_time + microseconds(next_timer), has_work);
+        }
+
+        _is_idle = false;
+    }
+
+    auto now = this->now();
+    _idle_time = _idle_time.load() + duration_cast<microseconds>(now - idle_start);
+
+    // the remaining activations only decay towards rest: do it analytically
+    Scalar idle_ms = duration_cast<duration<double, std::milli>>(now - idle_start).count();
+    auto decay = exp(-Dg * idle_ms);
+    for (auto i : _active_units) {
+        _activations(i) = rest_activations(i) + (_activations(i) - rest_activations(i)) * decay;
+    }
+
+    // resume stepping from now, as if the network had kept running
+    _last_timestamp = now;
+    _deadline = now;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::notify_activity() {
+
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (_is_idle) {
+        lock_guard<mutex> lock(_idle_mutex);
+        _idle_condition.notify_one();
+    }
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::record_step_profile() {
+
+    lock_guard<mutex> lock(_step_profile_mutex);
+
+    _step_profile.steps++;
+
+    for (size_t phase = 0; phase < StepProfile::NB_PHASES; phase++) {
+
+        auto duration = _phase_durations[phase];
+        _phase_durations[phase] = nanoseconds::zero();
+
+        _step_profile.total[phase] += duration;
+
+        size_t bin = 0;
+        for (auto ns = duration.count(); ns > 1 && bin < StepProfile::HISTOGRAM_BINS - 1; ns >>= 1) {
+            bin++;
+        }
+        _step_profile.histograms[phase][bin]++;
+    }
+}
+
+template<typename Scalar>
+StepProfile BasicMemoryNetwork<Scalar>::step_profile() const {
+    lock_guard<mutex> lock(_step_profile_mutex);
+    return _step_profile;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::reset_step_profile() {
+    lock_guard<mutex> lock(_step_profile_mutex);
+    _step_profile = StepProfile();
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::log_activations(shared_ptr<ActivationsSink> sink) {
+
+    if (_is_running) {
+        throw runtime_error("The logging sinks can not be changed while the network is running.");
+    }
+    _activations_sink = sink;
+    reserve_sinks();
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::log_external_activations(shared_ptr<ActivationsSink> sink) {
+
+    if (_is_running) {
+        throw runtime_error("The logging sinks can not be changed while the network is running.");
+    }
+    _external_activations_sink = sink;
+    reserve_sinks();
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::record_activations(shared_ptr<ActivationsRecorder> recorder) {
+
+    if (_is_running) {
+        throw runtime_error("The activations recorder can not be changed while the network is running.");
+    }
+    if (recorder) recorder->add_units(0, _units.names());
+    _recorder = recorder;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::log_history(shared_ptr<ActivationsHistory> history) {
+
+    if (!_is_running) {
+        _history = history;
+        return;
+    }
+
+    lock_guard<mutex> lock(_pending_histories_mutex);
+    _pending_history = {true, history};
+    _has_pending_histories.store(true, memory_order_release);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::log_external_history(shared_ptr<ActivationsHistory> history) {
+
+    if (!_is_running) {
+        _external_history = history;
+        return;
+    }
+
+    lock_guard<mutex> lock(_pending_histories_mutex);
+    _pending_external_history = {true, history};
+    _has_pending_histories.store(true, memory_order_release);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::apply_pending_histories() {
+
+    if (!_has_pending_histories.load(memory_order_acquire)) return;
+
+    lock_guard<mutex> lock(_pending_histories_mutex);
+
+    if (_pending_history.pending) _history = move(_pending_history.history);
+    if (_pending_external_history.pending) _external_history = move(_pending_external_history.history);
+
+    _pending_history = {};
+    _pending_external_history = {};
+    _has_pending_histories.store(false, memory_order_relaxed);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::capture_checkpoint(Checkpoint& checkpoint, bool dense_weights) const {
+
+    auto n = size();
+
+    checkpoint.size = n;
+    checkpoint.storage = _weights_storage;
+    checkpoint.parameters = {{Dg, Lg, Eg, Ig, Amax, Amin, Arest, Winit}};
+    checkpoint.integrator = _integrator;
+    checkpoint.reference_period_ms = _reference_period_ms;
+    checkpoint.min_period = _min_period;
+
+    checkpoint.activations = _activations.head(n);
+    checkpoint.external_activations = external_activations.head(n);
+
+    // the timers and the expiries are saved relative to the current network
+    // time
+    auto now = _timers.now();
+    checkpoint.external_activations_expiry = external_activations_expiry.head(n).array() - double(now);
+
+    checkpoint.active_units = _active_units;
+
+    if (_weights_storage == WeightsStorage::Sparse) {
+        checkpoint.sparse_weights.assign(_sparse_weights.begin(), _sparse_weights.begin() + n);
+    }
+    else if (dense_weights) {
+        checkpoint.dense_weights = _weights.topLeftCorner(n, n);
+        checkpoint.connectivity = _connectivity.topLeftCorner(n, n);
+    }
+    else {
+        checkpoint.dense_weights.resize(n, n);
+        checkpoint.connectivity.resize(n, n);
+    }
+
+    checkpoint.journal_sequence = _journal_sequence;
+
+    checkpoint.timers.clear();
+    for (const auto& timer : _timers.pending()) {
+
+        auto delay = int64_t(timer.first) - int64_t(now);
+
+        // already due (but not fired yet): fires at the first step after
+        // restoring. If it is an expiry, its unit must still match it.
+        if (delay < 0) {
+            const auto& event = timer.second;
+            auto& expiry = checkpoint.external_activations_expiry;
+            if (event.expiry && event.activation.id < n && expiry(event.activation.id) == delay) {
+                expiry(event.activation.id) = 0;
             }
-            else
-            {
-            _weights(i,j) += Lg * dt_ms * _activations(i) * _activations(j) * (1 + _weights(i,j));
+            delay = 0;
+        }
+
+        checkpoint.timers.emplace_back(delay, timer.second);
+    }
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::serve_checkpoint_request(bool complete) {
+
+    lock_guard<mutex> lock(_checkpoint_mutex);
+
+    if (!_checkpoint_request) return;
+
+    // Copying dense weights is O(n^2): rather than stalling the network for
+    // the whole copy, the units state is captured now, and the weights
+    // column by column over the next steps (the columns about to be modified
+    // are copied first, see `step`). Sparse weights are captured at once.
+    if (!_capture) {
+        auto dense = _weights_storage == WeightsStorage::Dense;
+        capture_checkpoint(*_checkpoint_request, !dense);
+        if (dense) {
+            _capture = _checkpoint_request;
+            _capture_column = 0;
+            _captured_columns.assign(_capture->size, false);
+        }
+    }
+
+    if (_capture) {
+        auto n = _capture->size;
+        size_t budget = complete ? n * n : max(CHECKPOINT_WEIGHTS_PER_STEP, n);
+
+        for (; _capture_column < n && budget >= n; _capture_column++) {
+            if (_captured_columns[_capture_column]) continue;
+            capture_weights_column(_capture_column);
+            budget -= n;
+        }
+        if (_capture_column < n) return;
+
+        _capture = nullptr;
+    }
+
+    _checkpoint_request = nullptr;
+    _checkpoint_requested = false;
+    _checkpoint_condition.notify_all();
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::capture_weights_column(size_t j) {
+
+    auto n = _capture->size;
+    if (j >= n || _captured_columns[j]) return;
+
+    _capture->dense_weights.col(j) = _weights.col(j).head(n);
+    _capture->connectivity.col(j) = _connectivity.col(j).head(n);
+    _captured_columns[j] = true;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::request_checkpoint(Checkpoint& checkpoint) {
+
+    unique_lock<mutex> lock(_checkpoint_mutex);
+
+    if (!_serving_checkpoints) {
+        capture_checkpoint(checkpoint);
+        return;
+    }
+
+    // one request at a time
+    _checkpoint_condition.wait(lock, [this]() {return _checkpoint_request == nullptr;});
+
+    _checkpoint_request = &checkpoint;
+    _checkpoint_requested = true;
+
+    lock.unlock();
+    notify_activity(); // in case the network is idle
+    lock.lock();
+
+    _checkpoint_condition.wait(lock, [this, &checkpoint]() {return _checkpoint_request != &checkpoint;});
+}
+
+template<typename Scalar>
+size_t BasicMemoryNetwork<Scalar>::write_checkpoint(ostream& file, const Checkpoint& checkpoint) const {
+
+    // the names of the units added after the capture are saved as well:
+    // these units are still at rest
+    const auto& names = _units.names();
+    auto nb_names = _units.size();
+
+    auto n = checkpoint.size;
+
+    file.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    write_value(file, CHECKPOINT_VERSION);
+    write_value(file, uint32_t(sizeof(Scalar)));
+    write_value(file, uint32_t(checkpoint.storage));
+    write_value(file, uint32_t(checkpoint.integrator));
+    write_values(file, checkpoint.parameters.data(), checkpoint.parameters.size());
+    write_value(file, checkpoint.reference_period_ms);
+    write_value(file, int64_t(checkpoint.min_period.count()));
+
+    // unit names
+    write_value(file, uint64_t(nb_names));
+    for (size_t i = 0; i < nb_names; i++) {
+        write_value(file, uint32_t(names[i].size()));
+        file.write(names[i].data(), names[i].size());
+    }
+
+    // units state
+    write_value(file, uint64_t(n));
+    write_values(file, checkpoint.activations.data(), n);
+    write_values(file, checkpoint.external_activations.data(), n);
+    write_values(file, checkpoint.external_activations_expiry.data(), n);
+
+    write_value(file, uint64_t(checkpoint.active_units.size()));
+    for (auto id : checkpoint.active_units) write_value(file, uint64_t(id));
+
+    // weights
+    if (checkpoint.storage == WeightsStorage::Sparse) {
+
+        vector<uint64_t> ids;
+        vector<Scalar> weights;
+
+        for (const auto& connections : checkpoint.sparse_weights) {
+            ids.clear();
+            weights.clear();
+            for (const auto& c : connections) {
+                ids.push_back(c.id);
+                weights.push_back(c.weight);
+            }
+            write_value(file, uint64_t(connections.size()));
+            write_values(file, ids.data(), ids.size());
+            write_values(file, weights.data(), weights.size());
+        }
+    }
+    else {
+        // column-major, as in memory
+        write_values(file, checkpoint.dense_weights.data(), n * n);
+
+        write_values(file, checkpoint.connectivity.data(), n * n);
+    }
+
+    // pending timers
+    write_value(file, uint64_t(checkpoint.timers.size()));
+    for (const auto& timer : checkpoint.timers) {
+        const auto& activation = timer.second.activation;
+        write_value(file, timer.first);
+        write_value(file, uint8_t(timer.second.expiry));
+        write_value(file, uint64_t(activation.id));
+        write_value(file, activation.level);
+        write_value(file, int64_t(activation.duration.count()));
+        write_value(file, int64_t(activation.time.count()));
+        write_value(file, int64_t(activation.at_time.count()));
+    }
+
+    return nb_names;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::save_checkpoint(const string& filename) {
+
+    Checkpoint checkpoint;
+    request_checkpoint(checkpoint);
+
+    ofstream file(filename, ios::binary);
+    if (!file) {
+        throw runtime_error("Can not open " + filename + " to write the checkpoint.");
+    }
+
+    auto nb_names = write_checkpoint(file, checkpoint);
+
+    file.flush();
+    if (!file) {
+        throw runtime_error("Error while writing the checkpoint to " + filename);
+    }
+
+    cerr << "Checkpoint of " << nb_names << " units saved to " << filename << endl;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::read_checkpoint(istream& file,
+                                                 const string& filename,
+                                                 Checkpoint& checkpoint,
+                                                 vector<string>& names) const {
+
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    read_values(file, magic, sizeof(magic));
+    if (!equal(magic, magic + sizeof(magic), CHECKPOINT_MAGIC)) {
+        throw runtime_error(filename + " is not a memory network checkpoint.");
+    }
+
+    auto version = read_value<uint32_t>(file);
+    if (version != CHECKPOINT_VERSION) {
+        throw runtime_error("Unsupported checkpoint version " + to_string(version)
+                            + " (expected " + to_string(CHECKPOINT_VERSION) + ").");
+    }
+
+    auto scalar_size = read_value<uint32_t>(file);
+    if (scalar_size != sizeof(float) && scalar_size != sizeof(double)) {
+        throw runtime_error("Corrupted checkpoint: invalid scalar size.");
+    }
+
+    checkpoint.storage = static_cast<WeightsStorage>(read_value<uint32_t>(file));
+    checkpoint.integrator = static_cast<Integrator>(read_value<uint32_t>(file));
+    read_values(file, checkpoint.parameters.data(), checkpoint.parameters.size());
+    checkpoint.reference_period_ms = read_value<double>(file);
+    checkpoint.min_period = microseconds(read_value<int64_t>(file));
+
+    if (checkpoint.storage != WeightsStorage::Dense && checkpoint.storage != WeightsStorage::Sparse) {
+        throw runtime_error("Corrupted checkpoint: invalid weights storage.");
+    }
+
+    // the counts are checked against the size of the file before anything
+    // is allocated for them
+    names.resize(read_count(file, sizeof(uint32_t), "Corrupted checkpoint: invalid number of units."));
+    auto names_bytes = remaining_bytes(file);
+    for (auto& name : names) {
+        auto length = read_value<uint32_t>(file);
+        if (length + sizeof(uint32_t) > names_bytes) {
+            throw runtime_error("Corrupted checkpoint: invalid unit name.");
+        }
+        names_bytes -= length + sizeof(uint32_t);
+        name.resize(length);
+        read_values(file, &name[0], name.size());
+    }
+
+    // (activations, external activations and their expiries)
+    auto n = read_count(file, 2 * scalar_size + sizeof(double), "Corrupted checkpoint: invalid number of units.");
+    if (n > names.size()) {
+        throw runtime_error("Corrupted checkpoint: more units than unit names.");
+    }
+    checkpoint.size = n;
+
+    checkpoint.activations.resize(n);
+    checkpoint.external_activations.resize(n);
+    checkpoint.external_activations_expiry.resize(n);
+    read_scalars(file, checkpoint.activations.data(), n, scalar_size);
+    read_scalars(file, checkpoint.external_activations.data(), n, scalar_size);
+    read_values(file, checkpoint.external_activations_expiry.data(), n);
+
+    checkpoint.active_units.resize(read_count(file, sizeof(uint64_t), "Corrupted checkpoint: invalid active units."));
+    for (auto& id : checkpoint.active_units) {
+        id = read_value<uint64_t>(file);
+        if (id >= n) throw runtime_error("Corrupted checkpoint: invalid active unit.");
+    }
+
+    if (checkpoint.storage == WeightsStorage::Sparse) {
+
+        vector<uint64_t> ids;
+        vector<Scalar> weights;
+
+        checkpoint.sparse_weights.resize(n);
+        for (auto& connections : checkpoint.sparse_weights) {
+
+            auto nb_connections = read_value<uint64_t>(file);
+            if (nb_connections > n) throw runtime_error("Corrupted checkpoint: invalid connections.");
+
+            ids.resize(nb_connections);
+            weights.resize(nb_connections);
+            read_values(file, ids.data(), nb_connections);
+            read_scalars(file, weights.data(), nb_connections, scalar_size);
+
+            connections.resize(nb_connections);
+            for (size_t k = 0; k < nb_connections; k++) {
+                if (ids[k] >= n || (k > 0 && ids[k] <= ids[k - 1])) {
+                    throw runtime_error("Corrupted checkpoint: invalid connections.");
+                }
+                connections[k] = {ids[k], weights[k]};
             }
         }
     }
+    else {
+        if (n > 0 && n > remaining_bytes(file) / (scalar_size + sizeof(uint8_t)) / n) {
+            throw runtime_error("Corrupted checkpoint: truncated weights.");
+        }
 
+        checkpoint.dense_weights.resize(n, n);
+        read_scalars(file, checkpoint.dense_weights.data(), n * n, scalar_size);
 
-    // decay the external activations
-    for (size_t i = 0; i < external_activations.size(); i++) {
+        checkpoint.connectivity.resize(n, n);
+        read_values(file, checkpoint.connectivity.data(), n * n);
+    }
 
-        if (external_activations_decay(i) > 0) {
-            external_activations_decay(i) -= duration_cast<microseconds>(dt).count();
+    // (time, expiry flag, and the activation: id, level, duration, time and
+    // at_time)
+    const size_t timer_size = sizeof(int64_t) + sizeof(uint8_t)
+                              + sizeof(uint64_t) + sizeof(double) + 3 * sizeof(int64_t);
+    checkpoint.timers.resize(read_count(file, timer_size, "Corrupted checkpoint: invalid timers."));
+    for (auto& timer : checkpoint.timers) {
+        auto& activation = timer.second.activation;
+        timer.first = read_value<int64_t>(file);
+        timer.second.expiry = read_value<uint8_t>(file);
+        activation.id = read_value<uint64_t>(file);
+        activation.level = read_value<double>(file);
+        activation.duration = microseconds(read_value<int64_t>(file));
+        activation.time = microseconds(read_value<int64_t>(file));
+        activation.at_time = microseconds(read_value<int64_t>(file));
+
+        if (timer.first < 0 || activation.id >= names.size()) {
+            throw runtime_error("Corrupted checkpoint: invalid timer.");
         }
-        else {
-            external_activations(i) = 0;
+    }
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::restore_checkpoint(Checkpoint& checkpoint, const vector<string>& names) {
+
+    auto n = checkpoint.size;
+
+    // activations queued for the previous network
+    ExternalActivation activation;
+    while (_activations_queue.pop(activation)) {}
+
+    _units.clear();
+    _units.reserve(names.size());
+    for (const auto& name : names) _units.add(name);
+
+    Dg = checkpoint.parameters[0];
+    Lg = checkpoint.parameters[1];
+    Eg = checkpoint.parameters[2];
+    Ig = checkpoint.parameters[3];
+    Amax = checkpoint.parameters[4];
+    Amin = checkpoint.parameters[5];
+    Arest = checkpoint.parameters[6];
+    Winit = checkpoint.parameters[7];
+    _integrator = checkpoint.integrator;
+    _reference_period_ms = checkpoint.reference_period_ms;
+    _min_period = checkpoint.min_period;
+
+    // start again from an empty network of the right storage, then grow it
+    _size = 0;
+    _active_units.clear();
+    _is_active.clear();
+    _has_connections.clear();
+    _sparse_weights.clear();
+
+    _weights_storage = checkpoint.storage;
+    if (_weights_storage == WeightsStorage::Sparse) {
+        allocate_weights(0);
+    }
+    else if (_mapped_weights || size_t(_weights.rows()) != _capacity) {
+        allocate_weights(_capacity);
+    }
+
+    rest_activations.fill(Arest);
+    if (n > 0) resize(n);
+
+    _activations.head(n) = checkpoint.activations;
+    external_activations.head(n) = checkpoint.external_activations;
+    external_activations_expiry.head(n) = checkpoint.external_activations_expiry;
+
+    if (_weights_storage == WeightsStorage::Sparse) {
+        for (size_t i = 0; i < n; i++) {
+            _sparse_weights[i] = move(checkpoint.sparse_weights[i]);
+            _has_connections[i] = !_sparse_weights[i].empty();
+        }
+    }
+    else {
+        _weights.topLeftCorner(n, n) = checkpoint.dense_weights;
+        _connectivity.topLeftCorner(n, n) = checkpoint.connectivity;
+        for (size_t i = 0; i < n; i++) {
+            _has_connections[i] = checkpoint.connectivity.row(i).any();
+        }
+    }
+
+    for (auto id : checkpoint.active_units) wakeup(id);
+
+    _timers.clear();
+    for (const auto& timer : checkpoint.timers) _timers.schedule(timer.first, timer.second);
+
+    // the network time restarts from 0 at the next step
+    _is_started = false;
+    _elapsed_time = microseconds::zero();
+    _epoch = 0;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::load_checkpoint(const string& filename) {
+
+    if (_is_running) {
+        throw runtime_error("Can not load a checkpoint while the network is running.");
+    }
+    if (_journal) {
+        throw runtime_error("Can not load a checkpoint while journaling.");
+    }
+
+    ifstream file(filename, ios::binary);
+    if (!file) {
+        throw runtime_error("Can not open the checkpoint " + filename);
+    }
+
+    // read everything first: the network is left untouched if the
+    // checkpoint is invalid
+    Checkpoint checkpoint;
+    vector<string> names;
+    read_checkpoint(file, filename, checkpoint, names);
+
+    restore_checkpoint(checkpoint, names);
+
+    cerr << "Checkpoint of " << names.size() << " units loaded from " << filename << endl;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::save_weights(const string& filename) {
+
+    Checkpoint checkpoint;
+    request_checkpoint(checkpoint);
+
+    auto n = checkpoint.size;
+    const auto& names = _units.names();
+
+    if (checkpoint.storage == WeightsStorage::Sparse) {
+        checkpoint.dense_weights = Matrix::Zero(n, n);
+        checkpoint.connectivity = ConnectivityMatrix::Constant(n, n, false);
+        for (size_t i = 0; i < n; i++) {
+            for (const auto& c : checkpoint.sparse_weights[i]) {
+                checkpoint.dense_weights(i, c.id) = c.weight;
+                checkpoint.connectivity(i, c.id) = true;
+            }
+        }
+        checkpoint.sparse_weights.clear();
+    }
+
+    // connections are symmetric: the columns are faster to scan
+    vector<uint8_t> has_connections(n);
+    for (size_t i = 0; i < n; i++) has_connections[i] = checkpoint.connectivity.col(i).any();
+
+    size_t header = sizeof(WEIGHTS_MAGIC) + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t) + n;
+    for (size_t i = 0; i < n; i++) header += sizeof(uint32_t) + names[i].size();
+    auto offset = (header + WEIGHTS_ALIGNMENT - 1) / WEIGHTS_ALIGNMENT * WEIGHTS_ALIGNMENT;
+
+    ofstream file(filename, ios::binary);
+    if (!file) {
+        throw runtime_error("Can not open " + filename + " to write the weights.");
+    }
+
+    file.write(WEIGHTS_MAGIC, sizeof(WEIGHTS_MAGIC));
+    write_value(file, WEIGHTS_VERSION);
+    write_value(file, uint32_t(sizeof(Scalar)));
+    write_value(file, uint64_t(n));
+    write_value(file, uint64_t(offset));
+
+    for (size_t i = 0; i < n; i++) {
+        write_value(file, uint32_t(names[i].size()));
+        file.write(names[i].data(), names[i].size());
+    }
+    write_values(file, has_connections.data(), n);
+
+    vector<char> padding(offset - header, 0);
+    write_values(file, padding.data(), padding.size());
+
+    // column-major, as in memory
+    write_values(file, checkpoint.dense_weights.data(), n * n);
+
+    write_values(file, checkpoint.connectivity.data(), n * n);
+
+    file.flush();
+    if (!file) {
+        throw runtime_error("Error while writing the weights to " + filename);
+    }
+
+    cerr << "Weights of " << n << " units saved to " << filename << endl;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::map_weights(const string& filename) {
+
+    if (_is_running) {
+        throw runtime_error("Can not map weights while the network is running.");
+    }
+    if (_journal) {
+        throw runtime_error("Can not map weights while journaling.");
+    }
+
+    ifstream file(filename, ios::binary);
+    if (!file) {
+        throw runtime_error("Can not open the weights file " + filename);
+    }
+
+    char magic[sizeof(WEIGHTS_MAGIC)];
+    read_values(file, magic, sizeof(magic));
+    if (!equal(magic, magic + sizeof(magic), WEIGHTS_MAGIC)) {
+        throw runtime_error(filename + " is not a memory network weights file.");
+    }
+
+    auto version = read_value<uint32_t>(file);
+    if (version != WEIGHTS_VERSION) {
+        throw runtime_error("Unsupported weights file version " + to_string(version)
+                            + " (expected " + to_string(WEIGHTS_VERSION) + ").");
+    }
+
+    // the weights are used in place: no conversion possible
+    auto scalar_size = read_value<uint32_t>(file);
+    if (scalar_size != sizeof(Scalar)) {
+        throw runtime_error("The weights in " + filename + " are stored with " + to_string(scalar_size)
+                            + "-byte scalars: they can only be mapped by a network of the same precision.");
+    }
+
+    auto n = read_value<uint64_t>(file);
+    auto offset = read_value<uint64_t>(file);
+
+    // check the size of the file before trusting `n`
+    unique_ptr<MappedFile> mapped(new MappedFile(filename));
+
+    auto entry_size = sizeof(Scalar) + sizeof(uint8_t);
+    if (offset % WEIGHTS_ALIGNMENT != 0 || offset > mapped->size()
+        || (mapped->size() - offset) % entry_size != 0
+        || n >= (uint64_t(1) << 32) || n * n != (mapped->size() - offset) / entry_size) {
+        throw runtime_error("Corrupted weights file: invalid size.");
+    }
+
+    vector<string> names(n);
+    for (auto& name : names) {
+        name.resize(read_value<uint32_t>(file));
+        read_values(file, &name[0], name.size());
+    }
+
+    vector<uint8_t> has_connections(n);
+    read_values(file, has_connections.data(), n);
+
+    if (uint64_t(file.tellg()) > offset) {
+        throw runtime_error("Corrupted weights file: invalid weights offset.");
+    }
+
+    // Replace the state of the network
+    // ********************************
+
+    // activations queued for the previous network
+    ExternalActivation activation;
+    while (_activations_queue.pop(activation)) {}
+
+    _units.clear();
+    _units.reserve(n);
+    for (const auto& name : names) _units.add(name);
+
+    // allocated for exactly `n` units, as the mapped weights
+    for (auto vector : {&rest_activations, &external_activations, &internal_activations,
+                        &net_activations, &_activations}) {
+        vector->resize(n);
+    }
+    external_activations_expiry.resize(n);
+
+    rest_activations.fill(Arest);
+    external_activations.fill(0);
+    external_activations_expiry.fill(0);
+    internal_activations.fill(0);
+    net_activations.fill(0);
+    _activations.fill(Arest);
+
+    _weights_storage = WeightsStorage::Dense;
+    _sparse_weights.clear();
+    _weights_buffer.resize(0, 0);
+    _connectivity_buffer.resize(0, 0);
+
+    // the connectivity is not read: any non-zero byte is a connection
+    auto weights = mapped->data() + offset;
+    auto connectivity = weights + n * n * sizeof(Scalar);
+    new (&_weights) WeightsMap(reinterpret_cast<Scalar*>(weights), n, n);
+    new (&_connectivity) ConnectivityMap(reinterpret_cast<uint8_t*>(connectivity), n, n);
+    _mapped_weights = move(mapped);
+
+    _size = n;
+    _capacity = n;
+    reserve_sinks();
+
+    // connected units are always active
+    _active_units.clear();
+    _is_active.assign(n, false);
+    _has_connections.assign(n, false);
+    for (size_t i = 0; i < n; i++) {
+        if (!has_connections[i]) continue;
+        _has_connections[i] = true;
+        wakeup(i);
+    }
+
+    _timers.clear();
+
+    // the network time restarts from 0 at the next step
+    _is_started = false;
+    _elapsed_time = microseconds::zero();
+    _epoch = 0;
+
+    cerr << "Weights of " << n << " units mapped from " << filename << endl;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::journal_weights() {
+
+    // only the weights between stimulated units change (including the
+    // connections created by this step)
+    if (_stimulated_units.empty()) return;
+
+    auto& changes = _journal->claim();
+
+    for (auto i : _stimulated_units) {
+        for (auto j : _stimulated_units) {
+            if (_weights_storage == WeightsStorage::Sparse) {
+                const auto& connections = _sparse_weights[i];
+                auto it = find_connection(connections, j);
+                if (it == connections.end() || it->id != j) continue;
+
+                changes.push_back({i, j, it->weight});
+            }
+            else {
+                if (_connectivity(i,j) == 0) continue;
+
+                changes.push_back({i, j, _weights(i,j)});
+            }
+        }
+    }
+
+    if (!changes.empty()) _journal->publish(++_journal_sequence);
+}
+
+template<typename Scalar>
+size_t BasicMemoryNetwork<Scalar>::write_journal_base(const Checkpoint& checkpoint) {
+
+    // written aside, then renamed: a crash leaves either the previous base
+    // image or this one, complete
+    auto filename = _journal->filename() + ".base";
+    auto temporary = filename + ".tmp";
+
+    size_t nb_units;
+    {
+        ofstream file(temporary, ios::binary);
+        if (!file) {
+            throw runtime_error("Can not open " + temporary + " to write the base image of the journal.");
+        }
+
+        file.write(JOURNAL_BASE_MAGIC, sizeof(JOURNAL_BASE_MAGIC));
+        write_value(file, JOURNAL_BASE_VERSION);
+        write_value(file, uint64_t(checkpoint.journal_sequence));
+        nb_units = write_checkpoint(file, checkpoint);
+
+        file.flush();
+        if (!file) {
+            throw runtime_error("Error while writing the base image of the journal to " + temporary);
+        }
+    }
+
+    if (rename(temporary.c_str(), filename.c_str()) != 0) {
+        throw runtime_error("Can not replace the base image of the journal " + filename);
+    }
+
+    return nb_units;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::journal(const string& filename,
+                                         microseconds flush_period,
+                                         size_t capacity) {
+
+    if (_is_running) throw runtime_error("Can not start journaling while the network is running.");
+    if (_journal) throw runtime_error("The network is already journaling.");
+    if (_units.size() > WeightsJournal::MAX_UNITS) {
+        throw runtime_error("Can not journal a network of more than " + to_string(WeightsJournal::MAX_UNITS) + " units.");
+    }
+
+    // journal first: the units added while the base image is written are
+    // recorded
+    _journal.reset(new WeightsJournal(filename, flush_period, capacity));
+
+    try {
+        Checkpoint checkpoint;
+        capture_checkpoint(checkpoint);
+        write_journal_base(checkpoint);
+    }
+    catch (...) {
+        _journal.reset();
+        throw;
+    }
+
+    cerr << "Journaling the network to " << filename << endl;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::stop_journal() {
+
+    if (_is_running) throw runtime_error("Can not stop journaling while the network is running.");
+    if (!_journal) return;
+
+    auto journal = move(_journal);
+    journal->stop();
+
+    cerr << "Journal " << journal->filename() << " closed" << endl;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::compact_journal() {
+
+    if (!_journal) throw runtime_error("The network is not journaling.");
+
+    Checkpoint checkpoint;
+    request_checkpoint(checkpoint);
+
+    auto nb_units = write_journal_base(checkpoint);
+    _journal->compact(checkpoint.journal_sequence, nb_units);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::set_weight(size_t i, size_t j, Scalar weight) {
+
+    _has_connections[i] = true;
+    wakeup(i);
+
+    if (_weights_storage == WeightsStorage::Dense) {
+        _weights(i,j) = weight;
+        _connectivity(i,j) = true;
+        return;
+    }
+
+    auto& connections = _sparse_weights[i];
+    auto it = find_connection(connections, j);
+    if (it != connections.end() && it->id == j) it->weight = weight;
+    else connections.insert(it, {j, weight});
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::recover(const string& filename) {
+
+    if (_is_running) throw runtime_error("Can not recover a journal while the network is running.");
+    if (_journal) throw runtime_error("Can not recover a journal while journaling.");
+
+    auto base_filename = filename + ".base";
+    ifstream base(base_filename, ios::binary);
+    if (!base) {
+        throw runtime_error("Can not open the base image of the journal " + base_filename);
+    }
+
+    char magic[sizeof(JOURNAL_BASE_MAGIC)];
+    read_values(base, magic, sizeof(magic));
+    if (!equal(magic, magic + sizeof(magic), JOURNAL_BASE_MAGIC)) {
+        throw runtime_error(base_filename + " is not the base image of a memory network journal.");
+    }
+
+    auto version = read_value<uint32_t>(base);
+    if (version != JOURNAL_BASE_VERSION) {
+        throw runtime_error("Unsupported journal base image version " + to_string(version)
+                            + " (expected " + to_string(JOURNAL_BASE_VERSION) + ").");
+    }
+
+    auto sequence = read_value<uint64_t>(base);
+
+    // read everything first: the network is left untouched if the base
+    // image or the journal are invalid
+    Checkpoint checkpoint;
+    vector<string> names;
+    read_checkpoint(base, base_filename, checkpoint, names);
+
+    auto frames = WeightsJournal::read(filename);
+
+    // units added after the base image (or while it was written), in ID
+    // order
+    for (const auto& frame : frames) {
+        for (const auto& unit : frame.units) {
+            if (unit.first < names.size()) continue;
+            if (unit.first > names.size()) {
+                throw runtime_error("Corrupted journal: unit " + to_string(unit.first) + " is missing.");
+            }
+            names.push_back(unit.second);
+        }
+
+        for (const auto& change : frame.changes) {
+            if (change.i >= names.size() || change.j >= names.size()) {
+                throw runtime_error("Corrupted journal: invalid connection.");
+            }
+        }
+    }
+
+    restore_checkpoint(checkpoint, names);
+    if (_units.size() > size()) resize(_units.size());
+
+    // the frames only made of steps older than the base image are already
+    // in it. The others hold the latest weights of the pairs they contain.
+    size_t nb_changes = 0;
+    for (const auto& frame : frames) {
+        if (frame.sequence <= sequence) continue;
+
+        for (const auto& change : frame.changes) {
+            set_weight(change.i, change.j, change.weight);
+            nb_changes++;
         }
     }
 
+    cerr << "Network of " << size() << " units recovered from " << base_filename
+         << " and " << nb_changes << " weights of the journal " << filename << endl;
 }
 
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::trace(bool enabled, size_t events_per_thread) {
+
+    if (enabled && !_tracer) _tracer.reset(new Tracer(events_per_thread));
+    _tracing = enabled;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::write_trace(ostream& os) const {
+
+    if (!_tracer) {
+        throw runtime_error("Tracing was never enabled: no trace to write.");
+    }
+    _tracer->write(os);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::write_trace(const string& filename) const {
+
+    if (!_tracer) {
+        throw runtime_error("Tracing was never enabled: no trace to write.");
+    }
+
+    ofstream file(filename);
+    if (!file) {
+        throw runtime_error("Can not open " + filename + " to write the trace.");
+    }
+
+    _tracer->write(file);
+
+    if (!file) {
+        throw runtime_error("Error while writing the trace to " + filename);
+    }
+    cerr << "Trace written to " << filename << endl;
+}
+
+template<typename Scalar>
+PacingStats BasicMemoryNetwork<Scalar>::pacing_stats() const {
+    lock_guard<mutex> lock(_pacing_stats_mutex);
+    return _pacing_stats;
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::reset_pacing_stats() {
+    lock_guard<mutex> lock(_pacing_stats_mutex);
+    _pacing_stats = PacingStats();
+}
+
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::update_weights(Scalar dt_ms) {
+
+    // only update weights (ie, learn) if the units are co-activated
+    auto learn = [this, dt_ms](size_t i, size_t j, Scalar& w) {
+        if (_integrator == Integrator::Exponential) {
+            // closed-form solution, W relaxing towards 1 (resp. -1)
+            auto rate = Lg * _activations(i) * _activations(j);
+            if (rate > 0) w = 1 - (1 - w) * exp(-rate * dt_ms);
+            else w = -1 + (1 + w) * exp(rate * dt_ms);
+            return;
+        }
+
+        if (_activations(i) * _activations(j) > 0)
+        {
+        w += Lg * dt_ms * _activations(i) * _activations(j) * (1 - w);
+        }
+        else
+        {
+        w += Lg * dt_ms * _activations(i) * _activations(j) * (1 + w);
+        }
+    };
+
+    // each block of stimulated units only updates its own rows of weights
+    auto cost = 4 * _stimulated_units.size();
+    parallel_for(_workers.get(), _stimulated_units.size(), cost, 1, [this, &learn](size_t begin, size_t end) {
+    for (auto k = begin; k < end; k++)
+    {
+        auto i = _stimulated_units[k];
+        for (auto j : _stimulated_units)
+        {
+            if (_weights_storage == WeightsStorage::Sparse) {
+                auto& connections = _sparse_weights[i];
+                auto it = find_connection(connections, j);
+                if (it == connections.end() || it->id != j) continue;
 
-void MemoryNetwork::printout() {
+                learn(i, j, it->weight);
+            }
+            else {
+                if (_connectivity(i,j) == 0) continue;
 
-    cerr << "Weights" << endl << setprecision(2) << _weights << endl;
+                learn(i, j, _weights(i,j));
+            }
+        }
+    }
+    });
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::printout() {
+
+    cerr << "Weights" << endl << setprecision(2) << weights() << endl;
 
     cerr << setprecision(4) << setw(6) << fixed << "\033[2J";
     cerr << "ID\t\tExternal\tInternal\tNet\t\tActivation" << endl;
@@ -384,36 +2305,113 @@ void MemoryNetwork::printout() {
     cerr << endl;
 }
 
-void MemoryNetwork::incrementsize() {
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::reserve(size_t capacity) {
+
+    // the registry is not rehashed while running: other threads may be
+    // looking up names (`activate_unit(name)`). It grows as units are added.
+    if (_is_running) {
+        _requested_capacity = capacity;
+        notify_activity();
+        return;
+    }
+
+    _units.reserve(capacity);
+    if (capacity > _capacity) grow(capacity);
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::bind_weights() {
+
+    new (&_weights) WeightsMap(_weights_buffer.data(), _weights_buffer.rows(), _weights_buffer.cols());
+    new (&_connectivity) ConnectivityMap(_connectivity_buffer.data(),
+                                         _connectivity_buffer.rows(),
+                                         _connectivity_buffer.cols());
+    _mapped_weights.reset();
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::allocate_weights(size_t capacity) {
+
+    _weights_buffer = Matrix::Zero(capacity, capacity);
+    _connectivity_buffer = ConnectivityMatrix::Constant(capacity, capacity, false);
+    bind_weights();
+}
+
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::grow(size_t capacity) {
+
+    grow_vector(rest_activations, _size, capacity);
+    grow_vector(external_activations, _size, capacity);
+    grow_vector(external_activations_expiry, _size, capacity);
+    grow_vector(internal_activations, _size, capacity);
+    grow_vector(net_activations, _size, capacity);
+    grow_vector(_activations, _size, capacity);
+
+    _is_active.reserve(capacity);
+    _has_connections.reserve(capacity);
+
+    if (_weights_storage == WeightsStorage::Sparse) {
+        _sparse_weights.reserve(capacity);
+    }
+    else {
+        Matrix weights = Matrix::Zero(capacity, capacity);
+        weights.topLeftCorner(_size, _size) = _weights.topLeftCorner(_size, _size);
+        _weights_buffer.swap(weights);
+
+        ConnectivityMatrix connectivity = ConnectivityMatrix::Constant(capacity, capacity, false);
+        connectivity.topLeftCorner(_size, _size) = _connectivity.topLeftCorner(_size, _size);
+        _connectivity_buffer.swap(connectivity);
+
+        // the old weights (possibly mapped) are not needed anymore
+        bind_weights();
+    }
 
-    auto size = _size + 1;
+    _capacity = capacity;
+    reserve_sinks();
+}
 
-    rest_activations.conservativeResize(size);
-    rest_activations(size-1) = Arest;
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::reserve_sinks() {
+    for (const auto& sink : {_activations_sink, _external_activations_sink}) {
+        if (sink) sink->reserve(_capacity);
+    }
+}
 
-    external_activations.conservativeResize(size);
-    external_activations(size-1) = 0;
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::resize(size_t size) {
 
-    external_activations_decay.conservativeResize(size);
-    external_activations_decay(size-1) = 0;
+    if (size > _capacity) grow(max(max(size, 2 * _capacity), MIN_CAPACITY));
 
-    internal_activations.conservativeResize(size);
-    internal_activations(size-1) = 0;
+    auto nb_new_units = size - _size;
 
-    net_activations.conservativeResize(size);
-    net_activations(size-1) = 0;
+    rest_activations.segment(_size, nb_new_units).fill(Arest);
+    external_activations.segment(_size, nb_new_units).fill(0);
+    external_activations_expiry.segment(_size, nb_new_units).fill(0);
+    internal_activations.segment(_size, nb_new_units).fill(0);
+    net_activations.segment(_size, nb_new_units).fill(0);
+    _activations.segment(_size, nb_new_units).fill(Arest);
 
-    _activations.conservativeResize(size);
-    _activations(size-1) = Arest;
+    // new units are at rest, and not connected yet
+    _is_active.resize(size, false);
+    _has_connections.resize(size, false);
 
-    _weights.conservativeResize(size, size);
-    _weights.row(size-1).fill(NAN);
-    _weights.col(size-1).fill(NAN);
+    if (_weights_storage == WeightsStorage::Sparse) {
+        _sparse_weights.resize(size);
+    }
+    else {
+        _weights.block(_size, 0, nb_new_units, size).fill(0);
+        _weights.block(0, _size, size, nb_new_units).fill(0);
+
+        _connectivity.block(_size, 0, nb_new_units, size).fill(false);
+        _connectivity.block(0, _size, size, nb_new_units).fill(false);
+    }
 
     _size = size;
 }
 
-void MemoryNetwork::save_record() {
+template<typename Scalar>
+void BasicMemoryNetwork<Scalar>::save_record() {
 
     stringstream ss;
 
@@ -443,7 +2441,7 @@ void MemoryNetwork::save_record() {
         "-----\n"
         "\n";
 
-    for (const auto& unit: _units_names) {
+    for (const auto& unit: _units.names()) {
         ss << "- " << unit << "\n";
     }
 
@@ -452,19 +2450,84 @@ void MemoryNetwork::save_record() {
           "-----------\n"
           "\n";
 
-    for (const auto& unit: _units_names) {
-        if (_activations_history[unit_id(unit)].empty()) continue;
+    lock_guard<mutex> lock(_activations_history_mutex);
 
-        ss << "- " << unit << ":\n";
-        for (const auto& interval : _activations_history[unit_id(unit)]) {
-            chrono::microseconds start,duration;
-            float level;
-            tie(level,start,duration) = interval;
-
-            ss << "    - [" << duration_cast<milliseconds>(start).count() << "," << duration_cast<milliseconds>(start + duration).count() << "] at " << level << "\n";
+    for (size_t id = 0; id < _units.size(); id++) {
+        auto intervals = _activations_history.intervals(id);
+        if (intervals.empty()) continue;
 
+        ss << "- " << _units.name(id) << ":\n";
+        for (const auto& interval : intervals) {
+            ss << "    - [" << duration_cast<milliseconds>(interval.start).count() << "," << duration_cast<milliseconds>(interval.end).count() << "] at " << interval.level << "\n";
         }
     }
 
     cout << ss.str();
 }
+
+const char* StepProfile::phase_name(StepPhase phase) {
+
+    switch (phase) {
+        case StepPhase::Pacing: return "pacing";
+        case StepPhase::Resize: return "resize";
+        case StepPhase::ExternalActivations: return "external activations";
+        case StepPhase::Connections: return "connections";
+        case StepPhase::InternalActivations: return "internal activations";
+        case StepPhase::ActivationsUpdate: return "activations update";
+        case StepPhase::Logging: return "logging";
+        case StepPhase::WeightsUpdate: return "weights update";
+        case StepPhase::Snapshot: return "snapshot";
+    }
+    return "";
+}
+
+ostream& operator<<(ostream& os, const StepProfile& profile) {
+
+    auto step_total = nanoseconds::zero();
+    for (auto total : profile.total) step_total += total;
+
+    auto flags = os.flags();
+    auto precision = os.precision();
+
+    os << fixed << setprecision(2);
+    os << left << setw(22) << "phase"
+       << right << setw(12) << "total (ms)"
+       << setw(12) << "mean (us)"
+       << setw(12) << "p99 (us)"
+       << setw(10) << "share" << endl;
+
+    for (size_t phase = 0; phase < StepProfile::NB_PHASES; phase++) {
+
+        auto total = profile.total[phase];
+        const auto& histogram = profile.histograms[phase];
+
+        // upper bound of the bin holding the 99th percentile
+        size_t count = 0, bin = 0;
+        for (; bin < StepProfile::HISTOGRAM_BINS; bin++) {
+            count += histogram[bin];
+            if (count * 100 >= profile.steps * 99) break;
+        }
+        auto p99 = (bin < StepProfile::HISTOGRAM_BINS) ? (uint64_t(2) << bin) / 1000. : NAN;
+
+        os << left << setw(22) << StepProfile::phase_name(static_cast<StepPhase>(phase))
+           << right << setw(12) << total.count() / 1e6
+           << setw(12) << (profile.steps ? total.count() / 1e3 / profile.steps : 0.)
+           << setw(12) << p99
+           << setw(9) << (step_total.count() ? 100. * total.count() / step_total.count() : 0.) << "%" << endl;
+    }
+
+    os << left << setw(22) << "step"
+       << right << setw(12) << step_total.count() / 1e6
+       << setw(12) << (profile.steps ? step_total.count() / 1e3 / profile.steps : 0.)
+       << "  (" << profile.steps << " steps)" << endl;
+
+    os.flags(flags);
+    os.precision(precision);
+
+    return os;
+}
+
+template class BasicMemoryNetwork<double>;
+template class BasicMemoryNetwork<float>;
+template class BasicMemorySnapshot<double>;
+template class BasicMemorySnapshot<float>;
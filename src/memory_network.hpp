@@ -8,20 +8,159 @@
 #include <random>
 #include <chrono>
 #include <thread>
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <array>
+#include <iosfwd>
+
+#include "activations_history.hpp"
+#include "activations_recorder.hpp"
+#include "activations_sink.hpp"
+#include "activation_intervals.hpp"
+#include "mapped_file.hpp"
+#include "mpsc_queue.hpp"
+#include "timer_wheel.hpp"
+#include "tracer.hpp"
+#include "unit_registry.hpp"
+#include "weights_journal.hpp"
+#include "worker_pool.hpp"
 
 typedef Eigen::MatrixXd MemoryMatrix;
 typedef Eigen::VectorXd MemoryVector;
+// bytes rather than `bool`s, tested against 0: the connectivity can be
+// mapped from a file (see `map_weights`), where any byte value must be valid
+typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic> ConnectivityMatrix;
+
+// read-only view on (part of) a MemoryVector
+typedef Eigen::Ref<const MemoryVector> MemoryVectorRef;
 
 
 typedef std::function<void(std::chrono::duration<long int, std::micro>,
-                           const MemoryVector&)> LoggingFunction;
+                           const MemoryVectorRef&)> LoggingFunction;
+
+typedef std::function<std::chrono::high_resolution_clock::time_point()> ClockFunction;
+
+/** Storage backend for the network weights.
+ *
+ * - `Dense`: a full n x n matrix. Fast for small, densely connected networks,
+ *   but memory and step time grow as O(n^2).
+ * - `Sparse`: per-unit adjacency lists that only store the connections
+ *   actually established between co-activated units. Memory and step time
+ *   grow with the number of connections.
+ */
+enum class WeightsStorage {Dense, Sparse};
+
+/** Time integration scheme of the network dynamics.
+ *
+ * - `Euler`: explicit Euler, the original scheme. The external and internal
+ *   inputs are applied once per step, and the decay and the learning are
+ *   scaled by dt. Only stable for short periods (Dg * dt << 1).
+ * - `Exponential`: exact integration of the activations and the weights
+ *   over dt, assuming the inputs constant over the step. Stable (and
+ *   accurate) for any dt, so that the network can be stepped much less
+ *   often. See `BasicMemoryNetwork::integrator`.
+ */
+enum class Integrator {Euler, Exponential};
+
+/** Timing statistics of the fixed-rate pacing (see
+ * `BasicMemoryNetwork::fixed_rate`).
+ */
+struct PacingStats {
+
+    static const size_t HISTOGRAM_BINS = 24;
+
+    // number of paced steps
+    size_t steps = 0;
+
+    // deadlines skipped because a step overran by more than a period
+    size_t missed_deadlines = 0;
+
+    // how late the steps started, compared to their deadlines
+    std::chrono::nanoseconds max_jitter{0};
+    std::chrono::nanoseconds total_jitter{0};
+    std::chrono::nanoseconds mean_jitter() const {
+        return steps ? total_jitter / static_cast<std::chrono::nanoseconds::rep>(steps)
+                     : std::chrono::nanoseconds::zero();
+    }
+
+    // step latency (from the deadline to the end of the step), with log2
+    // bins: bin k counts latencies in [2^k, 2^(k+1)) microseconds (bin 0
+    // also counts latencies below 1us, the last bin anything above).
+    std::array<size_t, HISTOGRAM_BINS> latency_histogram{};
+};
+
+/** The phases of a network step, as timed by the step profiler (see
+ * `BasicMemoryNetwork::profile`).
+ */
+enum class StepPhase {
+    Pacing,              // waiting for the step (maximum frequency)
+    Resize,              // allocating the new units
+    ExternalActivations, // timers (scheduled activations, expiries) and queued activations
+    Connections,         // connecting the co-stimulated units
+    InternalActivations,
+    ActivationsUpdate,   // net input, decay and clamping
+    Logging,             // logging callbacks
+    WeightsUpdate,
+    Snapshot             // active set bookkeeping and snapshot publication
+};
+
+/** Cumulative timings of the phases of the network steps (see
+ * `BasicMemoryNetwork::profile`).
+ *
+ * Can be printed as a table with `operator<<`.
+ */
+struct StepProfile {
+
+    static const size_t NB_PHASES = 9;
+    static const size_t HISTOGRAM_BINS = 32;
+
+    static const char* phase_name(StepPhase phase);
+
+    // number of profiled steps
+    size_t steps = 0;
 
-class MemoryNetwork
+    // total time spent in each phase (indexed by StepPhase)
+    std::array<std::chrono::nanoseconds, NB_PHASES> total{};
+
+    // duration of each phase, per step, with log2 bins: bin k counts
+    // durations in [2^k, 2^(k+1)) nanoseconds.
+    std::array<std::array<size_t, HISTOGRAM_BINS>, NB_PHASES> histograms{};
+};
+
+std::ostream& operator<<(std::ostream& os, const StepProfile& profile);
+
+template<typename Scalar> class BasicMemorySnapshot;
+template<typename Scalar> class BasicMemoryEnsemble;
+
+/** An associative memory network, parameterized on the floating-point type
+ * used for the activations and the weights.
+ *
+ * `MemoryNetwork` (double precision) and `MemoryNetworkf` (single precision)
+ * are the two available instantiations. Single precision halves the memory
+ * used by the weights, and doubles the width of the vectorized kernels.
+ */
+template<typename Scalar>
+class BasicMemoryNetwork
 {
 
 public:
 
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Matrix;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+    typedef Eigen::Ref<const Vector> VectorRef;
+
+    typedef std::function<void(std::chrono::duration<long int, std::micro>,
+                               const VectorRef&)> LoggingFunction;
+
+    typedef BasicMemorySnapshot<Scalar> Snapshot;
+    typedef BasicActivationsSink<Scalar> ActivationsSink;
+    typedef BasicActivationsHistory<Scalar> ActivationsHistory;
+    typedef BasicActivationsRecorder<Scalar> ActivationsRecorder;
+    typedef BasicWeightsJournal<Scalar> WeightsJournal;
+
     /** Creates a new associative memory network, initially empty.
      *
      * Call `add_unit` to add new units to the network. `size` returns the
@@ -31,24 +170,42 @@ public:
      * any time, including when the network is running.
      *
      */
-    MemoryNetwork(LoggingFunction activations_log_fn = nullptr, // user-defined callback used to store activation history
-                  LoggingFunction external_activations_log_fn = nullptr, // user-defined callback used to store external activation history
-                  double Dg = 0.2,     // activation decay (per ms)
-                  double Lg = 0.01,    // learning rate (per ms)
-                  double Eg = 0.6,     // external influence
-                  double Ig = 0.3,     // internal influence
-                  double Amax = 1.0,   // maximum activation
-                  double Amin = -0.2,  // minimum activation
-                  double Arest = -0.1, // rest activation
-                  double Winit = 0.0); // initial weights
+    BasicMemoryNetwork(LoggingFunction activations_log_fn = nullptr, // user-defined callback used to store activation history
+                       LoggingFunction external_activations_log_fn = nullptr, // user-defined callback used to store external activation history
+                       double Dg = 0.2,     // activation decay (per ms)
+                       double Lg = 0.01,    // learning rate (per ms)
+                       double Eg = 0.6,     // external influence
+                       double Ig = 0.3,     // internal influence
+                       double Amax = 1.0,   // maximum activation
+                       double Amin = -0.2,  // minimum activation
+                       double Arest = -0.1, // rest activation
+                       double Winit = 0.0); // initial weights
 
+    /** Resets the activations and the weights (the units are kept).
+     *
+     * Raises a `runtime_error` if the network is journaling (see
+     * `journal`).
+     */
     void reset();
 
     /** Activate one unit at a specific level, for a specific duration.
+     *
+     * Can be called from any thread: the activation is queued (without
+     * blocking) and applied at the beginning of the next network step. If
+     * the queue is full, the activation is dropped (see
+     * `dropped_activations`).
+     *
+     * If `at_time` (a network time, see `elapsed_time`) is in the future,
+     * the activation is instead scheduled, and applied at the first step
+     * that reaches `at_time`.
+     *
+     * The activation lasts for the steps until `duration` has elapsed (at
+     * least one step).
      */
     void activate_unit(size_t id, 
                     double level = 1.0, 
-                    std::chrono::microseconds duration = std::chrono::milliseconds(200));
+                    std::chrono::microseconds duration = std::chrono::milliseconds(200),
+                    std::chrono::microseconds at_time = std::chrono::microseconds::zero());
 
     /** Activate one unit at a specific level, for a specific duration.
      *
@@ -56,24 +213,78 @@ public:
      */
     void activate_unit(const std::string& name, 
                     double level = 1.0, 
-                    std::chrono::microseconds duration = std::chrono::milliseconds(200));
+                    std::chrono::microseconds duration = std::chrono::milliseconds(200),
+                    std::chrono::microseconds at_time = std::chrono::microseconds::zero());
+
+    /** Activate one unit, named by the `length` characters at `name`, at a
+     * specific level, for a specific duration.
+     *
+     * Raises a `range_error` exception is the unit does not exist.
+     */
+    void activate_unit(const char* name,
+                    size_t length,
+                    double level = 1.0,
+                    std::chrono::microseconds duration = std::chrono::milliseconds(200),
+                    std::chrono::microseconds at_time = std::chrono::microseconds::zero());
+
+    /** Schedules an activation of one unit at network time `at_time` (see
+     * `activate_unit`), without going through the activations queue: any
+     * number of activations can be scheduled upfront (eg, a whole
+     * experiment), none is dropped. Before the network is started (or after
+     * `reset` or `stop`), `at_time` is counted from the next start.
+     *
+     * If the network thread is running, this is the same as `activate_unit`.
+     * Otherwise, it must be called from the thread that steps the network
+     * (see `step_n`).
+     *
+     * Raises a `range_error` exception is the unit does not exist.
+     */
+    void schedule_activation(size_t id,
+                             double level,
+                             std::chrono::microseconds duration,
+                             std::chrono::microseconds at_time);
+
+    void schedule_activation(const std::string& name,
+                             double level,
+                             std::chrono::microseconds duration,
+                             std::chrono::microseconds at_time);
 
     /** Returns the list of all unit names, ordered by their internal IDs.
      *
      * The order is guaranteed to remain the same from one call to the other,
      * even after calling `reset` or `stop`.
      */
-    std::vector<std::string> units_names() const {return _units_names;}
+    std::vector<std::string> units_names() const {return _units.names();}
+
+    /** Returns the number of external activations dropped so far because
+     * the input queue was full.
+     */
+    size_t dropped_activations() const {return _dropped_activations;}
 
     /**
      * Adds a new unit to the network.
      *
      * Returns the internal ID of the newly created unit.
      *
-     * Raises a `runtime_error` if the name is already in used.
+     * Raises a `runtime_error` if the name is already in used, or if the
+     * network is journaling and already has `WeightsJournal::MAX_UNITS`
+     * units.
      */
     size_t add_unit(const std::string& name);
 
+    /** Adds several new units at once. Faster than repeatedly calling
+     * `add_unit` for large vocabularies.
+     *
+     * Returns the internal ID of the first new unit: the IDs of the other
+     * ones follow, in order.
+     *
+     * Raises a `runtime_error` if one of the names is already in used, or
+     * appears twice in `names`, or if the network is journaling and would
+     * exceed `WeightsJournal::MAX_UNITS` units. No unit is added in that
+     * case.
+     */
+    size_t add_units(const std::vector<std::string>& names);
+
     /** Returns true if the network already has a unit named `name`, false
      * otherwise.
      */
@@ -84,11 +295,89 @@ public:
      * Raises a `range_error` exception is the unit does not exist.
      */
     size_t unit_id(const std::string& name) const;
+    size_t unit_id(const char* name, size_t length) const;
+
+    /** Returns a copy of the current activations.
+     *
+     * The activations are read while the network thread may be updating
+     * them: use `snapshot` for a consistent view from another thread.
+     */
+    Vector activations() const {return _activations.head(_size);}
+
+    /** Returns the full weights matrix. Units that are not connected have a
+     * NaN weight.
+     *
+     * With sparse storage, the dense matrix is built on the fly: this is
+     * O(n^2) in time and memory. Prefer `weight(i, j)` for large networks.
+     */
+    Matrix weights() const;
+
+    /** Returns the weight of the connection between units `i` and `j`, or
+     * NaN if they are not connected.
+     */
+    Scalar weight(size_t i, size_t j) const;
 
-    MemoryVector activations() const {return _activations;}
-    MemoryMatrix weights() const {return _weights;}
+    /** Returns the latest snapshot of the network state published by the
+     * network thread (see `publish_snapshots`), or `nullptr` if none has
+     * been published yet.
+     *
+     * Snapshots are immutable: they can be read from any thread, without
+     * copy nor lock, while the network keeps running.
+     */
+    std::shared_ptr<const Snapshot> snapshot() const;
+
+    /** Enables (or disables) the publication of snapshots of the network
+     * state, at most once per `period` of network time. A period of 0
+     * publishes a snapshot after every step.
+     *
+     * Publishing a snapshot copies the activations and the weights: O(n^2)
+     * with dense storage, O(connections) with sparse storage.
+     */
+    void publish_snapshots(bool enabled,
+                           std::chrono::microseconds period = std::chrono::milliseconds(20));
+
+    /** Selects how the weights are stored (see `WeightsStorage`). Existing
+     * connections are preserved.
+     *
+     * Raises a `runtime_error` if the network is running.
+     */
+    void weights_storage(WeightsStorage storage);
+    WeightsStorage weights_storage() const {return _weights_storage;}
+
+    /** Selects the time integration scheme (see `Integrator`).
+     *
+     * With `Integrator::Exponential`, the net input of a unit (Eg and Ig)
+     * is turned into a rate: a gain of `net` per `reference_period`, the
+     * period at which the parameters were tuned (100us, ie 10kHz, for the
+     * default parameters). The activations then follow, over each step, the
+     * closed-form solution of
+     *
+     *   dA/dt = |net| / reference_period * (Atarget - A) - Dg * (A - Arest)
+     *
+     * with Atarget = Amax (resp. Amin) for a positive (resp. negative) net
+     * input, and the weights the closed-form solution of
+     *
+     *   dW/dt = Lg * Ai * Aj * (1 -/+ W)
+     *
+     * Raises a `runtime_error` if the network is running.
+     */
+    void integrator(Integrator integrator,
+                    std::chrono::microseconds reference_period = std::chrono::microseconds(100));
+    Integrator integrator() const {return _integrator;}
 
     size_t size() const {return _size;}
+
+    /** Pre-allocates room for `capacity` units, so that adding units up to
+     * that number does not require any reallocation.
+     *
+     * If the network is running, the network thread performs the
+     * allocation of the weights and activations at its next step, and the
+     * names of the units are not pre-allocated (they are looked up from
+     * other threads): call `reserve` before `start` to pre-allocate
+     * everything.
+     */
+    void reserve(size_t capacity);
+    size_t capacity() const {return _capacity;}
     int frequency() const {return _frequency;}
 
     /** Slow down the memory update mechanism (typically, for debugging) up to
@@ -100,6 +389,90 @@ public:
     void max_frequency(double freq);
     std::chrono::microseconds internal_period() const {return _min_period;}
 
+    /** Enables (or disables) fixed-rate pacing.
+     *
+     * By default, when a maximum frequency is set, each step sleeps for the
+     * remainder of the period, measured from the previous step: the actual
+     * rate drifts with the step duration and the scheduler wake-up latency.
+     * With fixed-rate pacing, the steps start on absolute deadlines (start
+     * time + k * period), with `sleep_until`. The last `spin` of each wait
+     * are busy-waited, to start the steps more precisely than the scheduler
+     * allows (at the cost of some CPU).
+     *
+     * If a step overruns by more than a period, the deadlines that were
+     * missed are skipped (the network does not try to catch up).
+     *
+     * Only used with physical time, a maximum frequency, and the default
+     * clock. Raises a `runtime_error` if the network is running.
+     */
+    void fixed_rate(bool enabled, std::chrono::microseconds spin = std::chrono::microseconds::zero());
+    bool is_fixed_rate() const {return _fixed_rate;}
+
+    /** Returns the timing statistics of the fixed-rate pacing, since the
+     * network started (or since `reset_pacing_stats`). Can be called from
+     * any thread.
+     */
+    PacingStats pacing_stats() const;
+    void reset_pacing_stats();
+
+    /** Enables (or disables) the idle mode of the network thread (see
+     * `start`).
+     *
+     * In idle mode, once the network is quiescent (no external activation,
+     * and every activation within `epsilon` of its rest value), the network
+     * thread stops stepping and sleeps until a unit is activated or added,
+     * or until the next scheduled activation. The activations are then
+     * decayed analytically over the time spent idle, and the network
+     * resumes.
+     *
+     * Only used with physical time and the default clock. Raises a
+     * `runtime_error` if the network is running.
+     */
+    void idle_mode(bool enabled, double epsilon = 1e-6);
+    bool is_idle_mode() const {return _idle_mode;}
+
+    /** Total time the network thread spent idle (see `idle_mode`).
+     */
+    std::chrono::microseconds idle_time() const {return _idle_time;}
+
+    /** Enables (or disables) the step profiler, which times each phase of
+     * the network steps (see `StepPhase`). Can be called at any time, from
+     * any thread. When disabled, the profiler costs one (relaxed) atomic
+     * load per step.
+     */
+    void profile(bool enabled) {_profiling = enabled;}
+    bool is_profiling() const {return _profiling;}
+
+    /** Returns the step profile accumulated since the profiler was first
+     * enabled (or since `reset_step_profile`). Can be called from any
+     * thread.
+     */
+    StepProfile step_profile() const;
+    void reset_step_profile();
+
+    /** Enables (or disables) tracing: the network records timed events
+     * (steps and their phases, resizes, activations queue drains, logging
+     * callbacks, idle periods, and `activate_unit` calls from any thread),
+     * to be written with `write_trace`.
+     *
+     * Each thread records into its own lock-free ring of
+     * `events_per_thread` events, allocated the first time tracing is
+     * enabled (later values are ignored); the oldest events are overwritten
+     * when a ring is full. Must not be called concurrently with itself.
+     */
+    void trace(bool enabled, size_t events_per_thread = 1 << 16);
+    bool is_tracing() const {return _tracing;}
+
+    /** Writes the recorded trace as Chrome trace JSON, which opens directly
+     * in Perfetto (https://ui.perfetto.dev). Can be called while the
+     * network runs.
+     *
+     * Raises a `runtime_error` if tracing was never enabled, or if the file
+     * can not be written.
+     */
+    void write_trace(const std::string& filename) const;
+    void write_trace(std::ostream& os) const;
+
     /** Changes between physical time and simulated time.
      *
      * By default, the network uses real, physical time.
@@ -110,6 +483,17 @@ public:
      */
     bool is_using_physical_time() const {return _use_physical_time;}
 
+    /** Sets the clock used to measure physical time (by default,
+     * `std::chrono::high_resolution_clock::now`). Pass `nullptr` to revert
+     * to the default clock.
+     *
+     * With a custom clock, the network never sleeps to honour
+     * `max_frequency`: the clock is entirely under the caller's control.
+     *
+     * Raises a `runtime_error` if the network is running.
+     */
+    void clock(ClockFunction clock);
+
     /** Returns the elapsed time since the network started.
      *
      * If the network has not started yet, returns 0.
@@ -147,57 +531,543 @@ public:
     void stop();
     bool isrunning() const {return _is_running;}
 
+    /** Synchronously advances the network by `n` steps, on the caller's
+     * thread.
+     *
+     * If the network was not started yet (or has been reset or stopped),
+     * the elapsed time starts from 0.
+     *
+     * Raises a `runtime_error` if the network thread is running (see
+     * `start`).
+     */
+    void step_n(size_t n = 1);
+
+    /** Synchronously advances the network, on the caller's thread, until
+     * `duration` has elapsed.
+     *
+     * With simulated time, this runs exactly `duration / internal_period()`
+     * steps, at full CPU speed. With physical time, this steps the network
+     * until the clock (see `clock`) reports that `duration` has passed.
+     *
+     * Raises a `runtime_error` if the network thread is running, or if using
+     * simulated time without a maximum frequency.
+     */
+    void run_for(std::chrono::microseconds duration);
+
+    /** Sets the number of threads used to compute each step (1 by default).
+     * 0 selects one thread per hardware thread.
+     *
+     * With several threads, the internal activations, the activations
+     * update and the weights update of large networks are split into blocks
+     * of units, computed by a persistent pool of threads. The results are
+     * bit-identical to the single-threaded ones.
+     *
+     * Raises a `runtime_error` if the network is running.
+     */
+    void threads(size_t nb_threads);
+    size_t threads() const {return _workers ? _workers->size() : 1;}
+
+    /** Logs the activations (resp. the external activations) of each step
+     * asynchronously, to `sink`: the network thread only copies them into
+     * the (pre-allocated) ring of the sink, and they are consumed on
+     * another thread. Pass `nullptr` to detach the sink.
+     *
+     * Unlike the logging callbacks, a slow consumer does not slow down the
+     * network, unless the sink uses the `Block` overflow policy.
+     *
+     * Raises a `runtime_error` if the network is running.
+     */
+    void log_activations(std::shared_ptr<ActivationsSink> sink);
+    void log_external_activations(std::shared_ptr<ActivationsSink> sink);
+
+    /** Records the activations (resp. the external activations) of (some
+     * of) the units in `history`, which can be read from any thread, while
+     * the network runs. Pass `nullptr` to detach the history.
+     *
+     * Can be called while the network runs (eg, to replace the history with
+     * one that covers the units added since): the network switches to the
+     * new history at its next step.
+     */
+    void log_history(std::shared_ptr<ActivationsHistory> history);
+    void log_external_history(std::shared_ptr<ActivationsHistory> history);
+
+    /** Streams the external activations applied to the network (and,
+     * optionally, sampled activations) to the file of `recorder`, with
+     * bounded memory (see `BasicActivationsRecorder`). Pass `nullptr` to
+     * detach the recorder.
+     *
+     * Raises a `runtime_error` if the network is running.
+     */
+    void record_activations(std::shared_ptr<ActivationsRecorder> recorder);
+
+    /** Records (or stops recording) the external activations applied to
+     * the network in memory, indexed by time (see `ActivationIntervals`),
+     * for the queries below and `save_record`. To keep them on disk
+     * instead, use `record_activations`.
+     */
     void record(bool enabled) {_is_recording=enabled;}
     bool isrecording() {return _is_recording;}
     void save_record();
 
-    double Dg;
-    double Lg;
-    double Eg;
-    double Ig;
-    double Amax;
-    double Amin;
-    double Arest;
-    double Winit;
+    /** Queries on the external activations recorded (see `record`), over
+     * [begin, end) of network time (shifted after a restart of the network,
+     * see `ActivationIntervals`):
+     *
+     * - `recorded_activations`: the intervals of constant external
+     *   activation of unit `id`;
+     * - `recorded_input`: the external activation of unit `id` at `time`;
+     * - `externally_active_units`: the units that had an external
+     *   activation;
+     * - `co_activated_units`: the units that had an external activation at
+     *   the same time as unit `id`, with for how long, longest first.
+     *
+     * Can be called from any thread, while the network runs. The network
+     * never waits for a query: the activations it applies while a query
+     * runs are only visible after its next step.
+     */
+    std::vector<ActivationInterval> recorded_activations(size_t id,
+                                                         std::chrono::microseconds begin = std::chrono::microseconds::min(),
+                                                         std::chrono::microseconds end = std::chrono::microseconds::max()) const;
+    float recorded_input(size_t id, std::chrono::microseconds time) const;
+    std::vector<size_t> externally_active_units(std::chrono::microseconds begin,
+                                                std::chrono::microseconds end) const;
+    std::vector<std::pair<size_t, std::chrono::microseconds>>
+    co_activated_units(size_t id,
+                       std::chrono::microseconds begin = std::chrono::microseconds::min(),
+                       std::chrono::microseconds end = std::chrono::microseconds::max()) const;
+
+    /** Saves the state of the network to a (versioned, binary) checkpoint
+     * file: parameters, integrator, maximum frequency, unit names, weights,
+     * activations, external activations and the pending timers (scheduled
+     * activations and expiries of the external activations).
+     *
+     * Can be called while the network runs: the network thread then copies
+     * its state at the end of a step, and the file is written by the
+     * calling thread. The units state is O(units), and sparse weights
+     * O(connections). Dense weights are O(units^2): they are copied over the
+     * following steps instead, a bounded number of columns per step, the
+     * columns about to be modified first, so that the checkpoint still
+     * holds the weights of the step it was requested at. External
+     * activations still in the queue (not seen by a step yet) are not
+     * saved.
+     *
+     * Raises a `runtime_error` if the file can not be written.
+     */
+    void save_checkpoint(const std::string& filename);
+
+    /** Restores a checkpoint written by `save_checkpoint`, replacing the
+     * units, the weights (and their storage), the activations, the pending
+     * timers and the parameters of the network. As after `stop`, the network
+     * time restarts from 0, and the pending timers keep their remaining
+     * delay.
+     *
+     * Raises a `runtime_error` if the network is running or journaling
+     * (see `journal`), or if the file is not a valid checkpoint.
+     */
+    void load_checkpoint(const std::string& filename);
+
+    /** Saves the unit names and the weights to a weights file, that can be
+     * memory-mapped by `map_weights`. The weights are always stored as a
+     * dense n x n matrix (built on the fly with sparse storage).
+     *
+     * Can be called while the network runs (see `save_checkpoint`).
+     *
+     * Raises a `runtime_error` if the file can not be written.
+     */
+    void save_weights(const std::string& filename);
+
+    /** Replaces the units and the weights of the network by the ones of a
+     * weights file written by `save_weights`, mapped in memory instead of
+     * loaded: this takes the same time whatever the size of the weights,
+     * and all the processes mapping the same file share one copy of the
+     * weights (the page cache). The storage becomes
+     * `WeightsStorage::Dense`, the activations are at rest, and the network
+     * time restarts from 0.
+     *
+     * The network can still learn: the mapping is copy-on-write, so that
+     * the pages of weights it modifies (only the connections between
+     * stimulated units) become private to this network. The file is never
+     * modified. Adding units (or reserving room for more) copies all the
+     * weights to private memory, and releases the file, as do `reset`,
+     * `load_checkpoint` and changing the storage.
+     *
+     * Raises a `runtime_error` if the network is running or journaling
+     * (see `journal`), if the file is not a valid weights file, or if it
+     * was saved by a network of the other precision (float vs double). The
+     * network is left untouched in that case.
+     */
+    void map_weights(const std::string& filename);
+
+    /** Returns true if the weights are mapped from a weights file (see
+     * `map_weights`).
+     */
+    bool has_mapped_weights() const {return bool(_mapped_weights);}
+
+    /** Starts journaling what the network learns to `filename`, so that it
+     * can be recovered after a crash (see `recover`).
+     *
+     * A base image of the network (a checkpoint, see `save_checkpoint`) is
+     * first written to `filename + ".base"`. Then, after each step, the
+     * network thread hands the weights the step changed to a background
+     * thread (see `WeightsJournal`), which appends them to the journal
+     * every `flush_period`: a crash loses at most the last `flush_period`
+     * of learning. If the background thread falls behind by more than
+     * `capacity` steps, the network waits for it.
+     *
+     * Only the base image holds the activations and the pending timers.
+     * Call `compact_journal` every now and then, so that the journal does
+     * not grow forever.
+     *
+     * Raises a `runtime_error` if the network is running or already
+     * journaling, if it has more than `WeightsJournal::MAX_UNITS` units, or
+     * if the files can not be written.
+     */
+    void journal(const std::string& filename,
+                 std::chrono::microseconds flush_period = std::chrono::milliseconds(100),
+                 size_t capacity = 256);
+
+    /** Writes the pending changes to the journal, and stops journaling.
+     *
+     * Raises a `runtime_error` if the network is running, or if the journal
+     * could not be written.
+     */
+    void stop_journal();
+    bool is_journaling() const {return bool(_journal);}
+
+    /** Writes a new base image of the network, and drops from the journal
+     * the changes it includes. Can be called while the network runs (the
+     * base image is captured and written as by `save_checkpoint`).
+     *
+     * Raises a `runtime_error` if the network is not journaling, or if the
+     * base image can not be written.
+     */
+    void compact_journal();
+
+    /** Rebuilds the network from the journal `filename` and its base image:
+     * restores the base image (see `load_checkpoint`), then adds the units
+     * and sets the weights recorded in the journal. The end of a journal
+     * that was being written when the process crashed is ignored.
+     *
+     * Does not resume journaling: call `journal` again for that.
+     *
+     * Raises a `runtime_error` if the network is running or journaling, or
+     * if the files are not a valid base image and journal.
+     */
+    void recover(const std::string& filename);
+
+    Scalar Dg;
+    Scalar Lg;
+    Scalar Eg;
+    Scalar Ig;
+    Scalar Amax;
+    Scalar Amin;
+    Scalar Arest;
+    Scalar Winit;
+
+    struct Connection {
+        size_t id;
+        Scalar weight;
+    };
 
 private:
-    MemoryVector rest_activations; // constant
+    Vector rest_activations; // constant
+
+    UnitRegistry _units;
+
+    Vector external_activations;
+    Eigen::VectorXd external_activations_expiry; // network time, in microseconds
+    Vector internal_activations;
+    Vector net_activations;
+    Vector _activations;
+    // All the vectors and matrices above and below are allocated for
+    // `_capacity` units. Only the first `_size` entries are in use.
+
+    // only used with WeightsStorage::Dense. Weights between units that are
+    // not connected are kept to 0, so that the internal activations are a
+    // plain (vectorized) matrix-vector product. `_connectivity` tells which
+    // units are actually connected.
+    //
+    // Views on either `_weights_buffer` and `_connectivity_buffer`, or the
+    // mapped weights file (see `map_weights`).
+    typedef Eigen::Map<Matrix, Eigen::AlignedMax> WeightsMap;
+    typedef Eigen::Map<ConnectivityMatrix> ConnectivityMap;
+    WeightsMap _weights{nullptr, 0, 0};
+    ConnectivityMap _connectivity{nullptr, 0, 0};
+
+    Matrix _weights_buffer;
+    ConnectivityMatrix _connectivity_buffer;
+    std::unique_ptr<MappedFile> _mapped_weights;
+
+    /** Points `_weights` and `_connectivity` at their buffers, and releases
+     * the mapped weights (if any).
+     */
+    void bind_weights();
+
+    /** Allocates (zeroed) dense weights for `capacity` units (0 to free
+     * them), in place of the current ones.
+     */
+    void allocate_weights(size_t capacity);
+
+    // only used with WeightsStorage::Sparse. For each unit, its connections,
+    // sorted by ID.
+    std::vector<std::vector<Connection>> _sparse_weights;
+
+    WeightsStorage _weights_storage = WeightsStorage::Dense;
+
+    Integrator _integrator = Integrator::Euler;
+    Scalar _reference_period_ms = 0.1; // only used by Integrator::Exponential
+
+    /** Returns the activation of a unit after `dt_ms`, with the exponential
+     * integrator.
+     */
+    Scalar integrate_activation(Scalar activation, Scalar net, Scalar rest, Scalar dt_ms) const;
+
+    // Active set: only the units listed in `_active_units` are updated at
+    // each step. A unit is put to sleep once it has no external input, no
+    // connection, and its activation has reached a fixed point of the
+    // decay: skipping it is then exact. Units are woken up when they
+    // receive an external activation or get connected.
+    std::vector<size_t> _active_units;
+    std::vector<char> _is_active; // not vector<bool>: written concurrently
+    std::vector<bool> _has_connections;
+
+    struct ExternalActivation {
+        size_t id;
+        double level;
+        std::chrono::microseconds duration;
+        std::chrono::microseconds time; // when activate_unit was called
+        std::chrono::microseconds at_time; // when to apply it (0: immediately)
+    };
+
+    /** Records an external activation applied at network time `now`.
+     */
+    void record_activation(const ExternalActivation& activation, std::chrono::microseconds now);
+
+    /** Adds the activations recorded by the network thread to the history.
+     * Unless `wait` is true, gives up if a query holds the history.
+     */
+    void flush_recorded_activations(bool wait);
+
+    /** Applies an external activation at network time `now`, and schedules
+     * its expiry.
+     */
+    void apply_activation(const ExternalActivation& activation, std::chrono::microseconds now);
+
+    // Scheduled activations, and expiries of the external activations. An
+    // expiry is ignored if the unit has been activated again since (ie, if
+    // it does not match `external_activations_expiry`).
+    struct TimerEvent {
+        ExternalActivation activation;
+        bool expiry;
+    };
+    TimerWheel<TimerEvent> _timers;
+
+    // a copy of the state saved by `save_checkpoint` (but the unit names)
+    struct Checkpoint {
+        size_t size;
+        WeightsStorage storage;
+        std::array<double, 8> parameters; // Dg, Lg, Eg, Ig, Amax, Amin, Arest, Winit
+        Integrator integrator;
+        double reference_period_ms;
+        std::chrono::microseconds min_period;
+        Vector activations;
+        Vector external_activations;
+        Eigen::VectorXd external_activations_expiry; // remaining, in microseconds
+        std::vector<size_t> active_units;
+        Matrix dense_weights;
+        ConnectivityMatrix connectivity;
+        std::vector<std::vector<Connection>> sparse_weights;
+        std::vector<std::pair<int64_t, TimerEvent>> timers; // remaining delay, in microseconds
+        uint64_t journal_sequence; // last step journaled
+    };
+
+    /** Copies the current state of the network into `checkpoint`. Times are
+     * made relative to the current network time. If `dense_weights` is
+     * false, the dense weights (and connectivity) are only allocated.
+     *
+     * *Needs to be called from the network update thread (or while the
+     * network is not running)!*
+     */
+    void capture_checkpoint(Checkpoint& checkpoint, bool dense_weights = true) const;
+
+    /** Writes a checkpoint (and the current unit names) to `os`. Returns
+     * the number of unit names written.
+     */
+    size_t write_checkpoint(std::ostream& os, const Checkpoint& checkpoint) const;
+
+    /** Reads a checkpoint (and its unit names) from `is`. `filename` is
+     * only used in the error messages.
+     */
+    void read_checkpoint(std::istream& is,
+                         const std::string& filename,
+                         Checkpoint& checkpoint,
+                         std::vector<std::string>& names) const;
+
+    /** Replaces the state of the network by a checkpoint.
+     */
+    void restore_checkpoint(Checkpoint& checkpoint, const std::vector<std::string>& names);
+
+    /** Captures the current state into `checkpoint`: on the network thread,
+     * at the end of its current step, if it is running.
+     */
+    void request_checkpoint(Checkpoint& checkpoint);
+
+    /** Captures the checkpoint requested by `request_checkpoint`, if any.
+     * With dense weights, the capture spans several calls (one per step),
+     * unless `complete` is true.
+     */
+    void serve_checkpoint_request(bool complete = false);
+
+    /** Copies column `j` of the weights into the checkpoint being captured,
+     * if not done yet.
+     */
+    void capture_weights_column(size_t j);
+
+    // dense weights capture in progress (network thread only)
+    Checkpoint* _capture = nullptr;
+    size_t _capture_column = 0;             // next column to copy
+    std::vector<bool> _captured_columns;
+
+    std::mutex _checkpoint_mutex;
+    std::condition_variable _checkpoint_condition;
+    Checkpoint* _checkpoint_request = nullptr;   // under `_checkpoint_mutex`
+    bool _serving_checkpoints = false;           // under `_checkpoint_mutex`
+    std::atomic<bool> _checkpoint_requested{false};
+
+    std::unique_ptr<WeightsJournal> _journal;
+    uint64_t _journal_sequence = 0; // steps journaled so far
+
+    /** Hands the weights changed by the current step to the journal.
+     */
+    void journal_weights();
+
+    /** Writes the base image of the journal (atomically replacing the
+     * previous one). Returns the number of units it holds.
+     */
+    size_t write_journal_base(const Checkpoint& checkpoint);
 
-    std::vector<std::string> _units_names;
+    /** Sets the weight of the connection from unit i to unit j, creating
+     * it if needed (only from i to j). Used to replay the journal.
+     */
+    void set_weight(size_t i, size_t j, Scalar weight);
+
+    // number of steps since the network started
+    size_t _epoch = 0;
+
+    bool _publish_snapshots = false;
+    std::chrono::microseconds _snapshots_period = std::chrono::microseconds::zero();
+    std::chrono::microseconds _last_snapshot_time = std::chrono::microseconds::zero();
+
+    // the latest published snapshot (accessed with std::atomic_load/store),
+    // and the previous one, recycled once readers have released it.
+    std::shared_ptr<const Snapshot> _snapshot;
+    std::shared_ptr<Snapshot> _spare_snapshot;
+
+    void publish_snapshot();
 
-    MemoryVector external_activations;
-    MemoryVector external_activations_decay;
-    MemoryVector internal_activations;
-    MemoryVector net_activations;
-    MemoryVector _activations;
-    MemoryMatrix _weights;
+    void wakeup(size_t id);
+
+    // units that currently have a non-zero external activation. Only those
+    // can create new connections or learn.
+    std::vector<size_t> _stimulated_units;
 
     LoggingFunction _log_activation;
     LoggingFunction _log_external_activation;
+    std::shared_ptr<ActivationsSink> _activations_sink;
+    std::shared_ptr<ActivationsSink> _external_activations_sink;
+
+    /** Pre-allocates the samples of the sinks for `_capacity` units (see
+     * `ActivationsSink::reserve`), so that publishing them never allocates.
+     */
+    void reserve_sinks();
+    std::shared_ptr<ActivationsHistory> _history;
+    std::shared_ptr<ActivationsHistory> _external_history;
+
+    // histories set by `log_history` (resp. `log_external_history`) while
+    // the network was running, picked up by the network thread at its next
+    // step
+    struct PendingHistory {
+        bool pending = false;
+        std::shared_ptr<ActivationsHistory> history;
+    };
+    PendingHistory _pending_history;
+    PendingHistory _pending_external_history;
+    std::mutex _pending_histories_mutex;
+    std::atomic<bool> _has_pending_histories{false};
+
+    /** Switches to the histories set while the network was running.
+     */
+    void apply_pending_histories();
+    std::shared_ptr<ActivationsRecorder> _recorder;
 
     std::random_device rd;
     std::default_random_engine gen;
 
+    // External activations received since the last step. Filled by
+    // `activate_unit` (possibly from other threads), drained by `step`.
+    MPSCQueue<ExternalActivation> _activations_queue;
+    std::atomic<size_t> _dropped_activations{0};
+
     void compute_internal_activations();
 
+    /** Returns true if units i and j are connected.
+     */
+    bool connected(size_t i, size_t j) const;
+
+    /** Creates a (symmetric) connection between units i and j, with initial
+     * weight Winit.
+     */
+    void connect(size_t i, size_t j);
+
+    void update_weights(Scalar dt_ms);
+
     void run();
     void step();
 
+    /** Resets the network time. Called before the first step.
+     */
+    void init_time();
+    std::chrono::high_resolution_clock::time_point now() const;
+
     size_t _size = 0;
+    size_t _capacity = 0;
+
+    // capacity requested by `reserve` while the network was running
+    std::atomic<size_t> _requested_capacity{0};
 
-    /** Conservatively increment the size the network. Conserves the current
+    /** Conservatively increase the size the network to `size` units.
+     * Conserves the current weights, activations. The capacity is grown
+     * geometrically, so that adding n units costs amortized O(n) per unit.
+     *
+     * *Needs to be called from the network update thread!*
+     */
+    void resize(size_t size);
+
+    /** Reallocates the network for `capacity` units. Conserves the current
      * weights, activations.
      *
      * *Needs to be called from the network update thread!*
      */
-    void incrementsize();
+    void grow(size_t capacity);
 
     std::thread _network_thread;
 
-    bool _is_running = false;
+    // only set when stepping with more than one thread
+    std::unique_ptr<WorkerPool> _workers;
+
+    // read by `activate_unit`, possibly from other threads
+    std::atomic<bool> _is_running{false};
+    std::atomic<bool> _is_started{false};
 
     bool _is_recording = false;
-    std::map<size_t, std::vector<std::tuple<float, std::chrono::microseconds, std::chrono::microseconds>>> _activations_history;
+
+    // external activations recorded, read by the queries (from any thread)
+    // under `_activations_history_mutex`. The network thread keeps the
+    // activations it applies in `_unrecorded_activations` until it gets the
+    // lock without waiting.
+    ActivationIntervals _activations_history;
+    mutable std::mutex _activations_history_mutex;
+    std::vector<ExternalActivation> _unrecorded_activations;
 
     void printout();
 
@@ -211,9 +1081,123 @@ private:
     std::chrono::high_resolution_clock::time_point _last_timestamp;
     std::chrono::high_resolution_clock::time_point _last_freq_computation;
 
+    bool _fixed_rate = false;
+    std::chrono::microseconds _spin = std::chrono::microseconds::zero();
+
+    // deadline of the current step, with fixed-rate pacing
+    std::chrono::high_resolution_clock::time_point _deadline;
+
+    PacingStats _pacing_stats;
+    mutable std::mutex _pacing_stats_mutex;
+
+    /** Returns true if the steps are paced on fixed-rate deadlines.
+     */
+    bool is_paced() const;
+
+    std::atomic<bool> _profiling{false};
+    StepProfile _step_profile;
+    mutable std::mutex _step_profile_mutex;
+
+    // timings of the phases of the current step, while profiling
+    std::array<std::chrono::nanoseconds, StepProfile::NB_PHASES> _phase_durations{};
+
+    /** Adds the timings of the current step to `_step_profile`.
+     */
+    void record_step_profile();
+
+    // created by the first call to `trace(true)`, and kept until the network
+    // is destroyed: `_tracing` is only set once it exists
+    std::unique_ptr<Tracer> _tracer;
+    std::atomic<bool> _tracing{false};
+
+    bool _idle_mode = false;
+    Scalar _idle_epsilon = 1e-6;
+    std::atomic<std::chrono::microseconds> _idle_time{std::chrono::microseconds::zero()};
+
+    // the network thread sleeps on `_idle_condition` while idle. Producers
+    // (`activate_unit`, `add_unit`, `stop`...) only take `_idle_mutex` to
+    // notify it if `_is_idle` is set.
+    std::atomic<bool> _is_idle{false};
+    std::mutex _idle_mutex;
+    std::condition_variable _idle_condition;
+
+    /** Returns true if nothing will change in the network until it receives
+     * new input (up to `_idle_epsilon`).
+     */
+    bool is_quiescent() const;
+
+    /** Sleeps until there is something to do, then decays the activations
+     * over the time spent idle.
+     */
+    void idle();
+
+    /** Wakes up the network thread if it is idle.
+     */
+    void notify_activity();
+
+    /** Waits for the deadline of the current step (skipping the deadlines
+     * already missed), and records the jitter.
+     */
+    void wait_for_deadline();
+
+    /** Records the latency of the step that just completed, and moves to
+     * the next deadline.
+     */
+    void complete_paced_step();
+
+    ClockFunction _clock;
+
     // only used when _use_physical_time = false
-    std::chrono::microseconds _elapsed_time;
+    std::atomic<std::chrono::microseconds> _elapsed_time;
+};
+
+/** An immutable, consistent snapshot of the state of a `BasicMemoryNetwork`,
+ * as returned by `BasicMemoryNetwork::snapshot`.
+ */
+template<typename Scalar>
+class BasicMemorySnapshot
+{
+
+public:
+
+    /** Number of network steps when the snapshot was taken.
+     */
+    size_t epoch = 0;
+
+    /** Network elapsed time when the snapshot was taken.
+     */
+    std::chrono::microseconds time;
+
+    typename BasicMemoryNetwork<Scalar>::Vector activations;
+
+    size_t size() const {return activations.size();}
+
+    /** Returns the weight of the connection between units `i` and `j`, or
+     * NaN if they are not connected.
+     */
+    Scalar weight(size_t i, size_t j) const;
+
+private:
+    friend class BasicMemoryNetwork<Scalar>;
+    friend class BasicMemoryEnsemble<Scalar>;
+
+    WeightsStorage storage;
+
+    typename BasicMemoryNetwork<Scalar>::Matrix dense_weights;
+    ConnectivityMatrix connectivity;
+    std::vector<std::vector<typename BasicMemoryNetwork<Scalar>::Connection>> sparse_weights;
 };
 
+// instantiated (and exported) by the library
+extern template class BasicMemoryNetwork<double>;
+extern template class BasicMemoryNetwork<float>;
+extern template class BasicMemorySnapshot<double>;
+extern template class BasicMemorySnapshot<float>;
+
+typedef BasicMemoryNetwork<double> MemoryNetwork;
+typedef BasicMemoryNetwork<float> MemoryNetworkf;
+
+typedef BasicMemorySnapshot<double> MemorySnapshot;
+typedef BasicMemorySnapshot<float> MemorySnapshotf;
 
 #endif
@@ -0,0 +1,107 @@
+#ifndef MPSC_QUEUE
+#define MPSC_QUEUE
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/** A bounded, wait-free, multi-producer single-consumer queue.
+ *
+ * `push` can be called from any number of threads. It never blocks nor
+ * allocates, and never retries: it is a fixed number of atomic operations.
+ * If the queue is full, the value is rejected. `pop` must only be called
+ * from a single (consumer) thread.
+ *
+ * A producer first reserves room in the queue (`_size`), then claims the
+ * next slot with a single `fetch_add` on `_tail`. The reservation
+ * guarantees that the slot was already freed by the consumer. Each slot
+ * carries a sequence number telling whether it is ready to be read: a slot
+ * claimed by a producer that has not written it yet is seen as empty, and
+ * read at a later `pop`.
+ */
+template<typename T>
+class MPSCQueue
+{
+
+public:
+
+    /** `capacity` is rounded up to the next power of two.
+     */
+    explicit MPSCQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+
+        _mask = size - 1;
+        _slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    /** Enqueues a value. Returns false (and drops the value) if the queue is
+     * full.
+     *
+     * Near capacity, a value can also be rejected while the push of another
+     * producer is being rejected (its reservation is briefly counted).
+     */
+    bool push(const T& value) {
+
+        if (_size.fetch_add(1, std::memory_order_acq_rel) > _mask) {
+            _size.fetch_sub(1, std::memory_order_relaxed);
+            return false; // full
+        }
+
+        // the consumer freed this slot before releasing its reservation
+        auto pos = _tail.fetch_add(1, std::memory_order_relaxed);
+        auto& slot = _slots[pos & _mask];
+
+        slot.value = value;
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Dequeues a value. Returns false if the queue is empty.
+     *
+     * *Must only be called from the consumer thread.*
+     */
+    bool pop(T& value) {
+
+        auto& slot = _slots[_head & _mask];
+        if (slot.sequence.load(std::memory_order_acquire) != _head + 1) return false;
+
+        value = slot.value;
+        slot.sequence.store(_head + _mask + 1, std::memory_order_relaxed);
+        _head++;
+        _size.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    /** Returns true if there is nothing to dequeue.
+     *
+     * *Must only be called from the consumer thread.*
+     */
+    bool empty() const {
+        return _slots[_head & _mask].sequence.load(std::memory_order_acquire) != _head + 1;
+    }
+
+private:
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    size_t _mask;
+
+    // keep the producers' and the consumer's indices on separate cache lines
+    std::atomic<size_t> _tail{0};
+    std::atomic<size_t> _size{0}; // values reserved and not popped yet
+    char _padding[64];
+    size_t _head = 0;
+};
+
+#endif
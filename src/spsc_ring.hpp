@@ -0,0 +1,120 @@
+#ifndef SPSC_RING
+#define SPSC_RING
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/** A bounded, lock-free, single-producer single-consumer ring of
+ * pre-allocated slots.
+ *
+ * Values are written and read in place: the producer `claim`s the next free
+ * slot, fills it and `publish`es it; the consumer reads the oldest published
+ * slot with `front`, then `release`s it. Slots are reused as is, so that
+ * values owning memory (eg, vectors) keep their allocation from one lap to
+ * the next.
+ */
+template<typename T>
+class SPSCRing
+{
+
+public:
+
+    /** `capacity` is rounded up to the next power of two.
+     */
+    explicit SPSCRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+
+        _mask = size - 1;
+        _slots.reset(new T[size]);
+    }
+
+    SPSCRing(const SPSCRing&) = delete;
+    SPSCRing& operator=(const SPSCRing&) = delete;
+
+    size_t capacity() const {return _mask + 1;}
+
+    /** Gives access to all the slots, eg to pre-allocate them. *Must not be
+     * called while the ring is in use.*
+     */
+    T& slot(size_t i) {return _slots[i];}
+
+    /** Calls `f` on each free slot (never published, or released by the
+     * consumer), eg to grow their allocation while the ring is in use.
+     *
+     * *Must only be called from the producer thread.*
+     */
+    template<typename F>
+    void for_each_free(F f) {
+        _cached_head = _head.load(std::memory_order_acquire);
+        for (auto i = _tail; i != _cached_head + capacity(); i++) f(_slots[i & _mask]);
+    }
+
+    /** Returns the next free slot, or nullptr if the ring is full. The slot
+     * is only visible to the consumer once published.
+     *
+     * *Must only be called from the producer thread.*
+     */
+    T* claim() {
+        if (_tail - _cached_head > _mask) {
+            _cached_head = _head.load(std::memory_order_acquire);
+            if (_tail - _cached_head > _mask) return nullptr;
+        }
+        return &_slots[_tail & _mask];
+    }
+
+    /** Makes the slot returned by the last `claim` visible to the consumer.
+     *
+     * *Must only be called from the producer thread.*
+     */
+    void publish() {
+        _tail++;
+        _published.store(_tail, std::memory_order_release);
+    }
+
+    /** Returns the oldest published slot, or nullptr if the ring is empty.
+     *
+     * *Must only be called from the consumer thread.*
+     */
+    T* front() {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head == _cached_tail) {
+            _cached_tail = _published.load(std::memory_order_acquire);
+            if (head == _cached_tail) return nullptr;
+        }
+        return &_slots[head & _mask];
+    }
+
+    /** Gives the slot returned by the last `front` back to the producer.
+     *
+     * *Must only be called from the consumer thread.*
+     */
+    void release() {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /** Number of published slots not released yet. Approximate if called
+     * while the ring is in use.
+     */
+    size_t size() const {
+        return _published.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+
+private:
+
+    std::unique_ptr<T[]> _slots;
+    size_t _mask;
+
+    // keep the producer's and the consumer's indices on separate cache
+    // lines. Each side caches the other side's index, and only reloads it
+    // when the ring looks full (resp. empty).
+    std::atomic<size_t> _published{0};
+    size_t _tail = 0;
+    size_t _cached_head = 0;
+    char _padding[64];
+    std::atomic<size_t> _head{0};
+    size_t _cached_tail = 0;
+};
+
+#endif
@@ -0,0 +1,276 @@
+#ifndef TIMER_WHEEL
+#define TIMER_WHEEL
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/** A hierarchical timer wheel: schedules values to be fired at given
+ * (integer) times.
+ *
+ * Timers are stored in `LEVELS` wheels of `SLOTS` slots each. Wheel 0 has
+ * one slot per time unit, wheel 1 one slot per `SLOTS` time units, etc. A
+ * timer is stored in the lowest wheel that can hold it, and moved down
+ * (cascaded) as the time gets closer. Scheduling is O(1), and advancing the
+ * time costs O(timers due) plus the number of (non-empty) slots crossed:
+ * timers that are not due are never looked at.
+ *
+ * Timers further in the future than the range of the wheels
+ * (`SLOTS^LEVELS` time units, ie 19 hours in microseconds) are kept in an
+ * overflow list, re-examined when the top wheel turns.
+ *
+ * Not thread-safe.
+ */
+template<typename T>
+class TimerWheel
+{
+
+public:
+
+    typedef uint64_t Time;
+
+    /** Schedules `value` to be fired at `time`. If `time` is already past,
+     * the value fires at the next call to `advance`.
+     */
+    void schedule(Time time, const T& value) {
+        insert({time, _sequence++, value});
+        _size++;
+    }
+
+    /** Advances the wheel to `time`, and calls `fire(time, value)` for each
+     * timer due at or before `time`, in chronological order. Timers due at
+     * the same time fire in the order they were scheduled.
+     *
+     * Timers scheduled from `fire` for a time that is already past fire at
+     * the next call to `advance`.
+     */
+    template<typename Function>
+    void advance(Time time, Function fire) {
+
+        _firing.clear();
+        _firing.swap(_due);
+
+        auto previous = _now;
+        if (time > _now) _now = time;
+
+        if (_now != previous) {
+
+            if ((previous >> (BITS * LEVELS)) != (_now >> (BITS * LEVELS))) {
+                _cascading.clear();
+                _cascading.swap(_overflow);
+                for (auto& timer : _cascading) cascade(std::move(timer));
+            }
+
+            // top-down, so that cascaded timers land in wheels that are not
+            // processed yet
+            for (auto level = LEVELS; level-- > 0;) {
+
+                auto shift = BITS * level;
+                auto first = (previous >> shift) + 1;
+                auto last = _now >> shift;
+                if (last < first) continue;
+
+                auto count = std::min(last - first + 1, Time(SLOTS));
+                for (Time k = 0; k < count; k++) {
+
+                    auto slot = (first + k) & (SLOTS - 1);
+                    if (!(_occupied[level] & (uint64_t(1) << slot))) continue;
+
+                    _occupied[level] &= ~(uint64_t(1) << slot);
+                    _cascading.clear();
+                    _cascading.swap(_wheels[level][slot]);
+                    for (auto& timer : _cascading) cascade(std::move(timer));
+                }
+            }
+        }
+
+        std::sort(_firing.begin(), _firing.end(), chronological);
+
+        _size -= _firing.size();
+        for (const auto& timer : _firing) fire(timer.time, timer.value);
+    }
+
+    /** Moves the origin of time to the current time: the wheel is back at
+     * time 0, and every pending timer keeps its remaining delay.
+     */
+    void rewind() {
+
+        std::vector<Timer> timers;
+        collect(timers);
+
+        // the timers already due all move to time 0: renumber them so that
+        // they still fire in chronological order
+        std::sort(timers.begin(), timers.end(), chronological);
+
+        for (auto& timer : timers) {
+            timer.time = timer.time > _now ? timer.time - _now : 0;
+            timer.sequence = _sequence++;
+        }
+        _now = 0;
+
+        for (auto& timer : timers) insert(std::move(timer));
+    }
+
+    /** Removes all the timers, and moves back to time 0.
+     */
+    void clear() {
+        std::vector<Timer> timers;
+        collect(timers);
+        _now = 0;
+        _size = 0;
+    }
+
+    Time now() const {return _now;}
+
+    /** Returns the pending timers, as (time, value) pairs, in the order they
+     * will fire.
+     */
+    std::vector<std::pair<Time, T>> pending() const {
+
+        std::vector<const Timer*> timers;
+        timers.reserve(_size);
+
+        for (unsigned level = 0; level < LEVELS; level++) {
+            for (Time slot = 0; slot < SLOTS; slot++) {
+                for (const auto& timer : _wheels[level][slot]) timers.push_back(&timer);
+            }
+        }
+        for (const auto* list : {&_overflow, &_due}) {
+            for (const auto& timer : *list) timers.push_back(&timer);
+        }
+
+        std::sort(timers.begin(), timers.end(), [](const Timer* a, const Timer* b) {
+            return chronological(*a, *b);
+        });
+
+        std::vector<std::pair<Time, T>> result;
+        result.reserve(timers.size());
+        for (const auto* timer : timers) result.emplace_back(timer->time, timer->value);
+        return result;
+    }
+
+    /** Returns a lower bound of the time of the next timer to fire: its
+     * exact time if it is in the lowest wheel, the beginning of its slot
+     * otherwise. Returns `std::numeric_limits<Time>::max()` if there is no
+     * pending timer.
+     */
+    Time next_time() const {
+
+        if (!_due.empty()) return _now;
+
+        // timers in a wheel all belong to the current turn of the wheel
+        // above, after the current slot: the first non-empty slot of the
+        // lowest non-empty wheel holds the next ones.
+        for (unsigned level = 0; level < LEVELS; level++) {
+
+            if (!_occupied[level]) continue;
+
+            auto shift = BITS * level;
+            auto current = (_now >> shift) & (SLOTS - 1);
+            auto next = _occupied[level] & ~((uint64_t(2) << current) - 1);
+
+            Time slot = 0;
+            while (next && !(next & 1)) {
+                next >>= 1;
+                slot++;
+            }
+
+            return ((_now >> (shift + BITS)) << (shift + BITS)) | (slot << shift);
+        }
+
+        auto next = std::numeric_limits<Time>::max();
+        for (const auto& timer : _overflow) next = std::min(next, timer.time);
+        return next;
+    }
+
+    /** Number of pending timers.
+     */
+    size_t size() const {return _size;}
+
+private:
+
+    static const unsigned BITS = 6;
+    static const Time SLOTS = Time(1) << BITS; // 64: one bit per slot in `_occupied`
+    static const unsigned LEVELS = 6;
+
+    struct Timer {
+        Time time;
+        uint64_t sequence;
+        T value;
+    };
+
+    std::vector<Timer> _wheels[LEVELS][SLOTS];
+    uint64_t _occupied[LEVELS] = {}; // non-empty slots of each wheel
+    std::vector<Timer> _overflow;
+    std::vector<Timer> _due; // already due: fired at the next `advance`
+
+    // scratch buffers, kept to avoid reallocations
+    std::vector<Timer> _firing;
+    std::vector<Timer> _cascading;
+
+    Time _now = 0;
+    uint64_t _sequence = 0;
+    size_t _size = 0;
+
+    static bool chronological(const Timer& a, const Timer& b) {
+        return a.time < b.time || (a.time == b.time && a.sequence < b.sequence);
+    }
+
+    /** Stores a timer in the lowest wheel that can hold it: the one of the
+     * most significant group of bits that differs between its time and the
+     * current time.
+     */
+    void insert(Timer&& timer) {
+
+        if (timer.time <= _now) {
+            _due.push_back(std::move(timer));
+            return;
+        }
+
+        auto diff = timer.time ^ _now;
+        for (unsigned level = 0; level < LEVELS; level++) {
+            if ((diff >> (BITS * (level + 1))) == 0) {
+                auto slot = (timer.time >> (BITS * level)) & (SLOTS - 1);
+                _wheels[level][slot].push_back(std::move(timer));
+                _occupied[level] |= uint64_t(1) << slot;
+                return;
+            }
+        }
+
+        _overflow.push_back(std::move(timer));
+    }
+
+    /** While advancing: fires the timer if it is due, re-inserts it closer
+     * to the current time otherwise.
+     */
+    void cascade(Timer&& timer) {
+        if (timer.time <= _now) _firing.push_back(std::move(timer));
+        else insert(std::move(timer));
+    }
+
+    /** Moves all the pending timers to `timers`, emptying the wheel.
+     */
+    void collect(std::vector<Timer>& timers) {
+
+        for (unsigned level = 0; level < LEVELS; level++) {
+            for (Time slot = 0; slot < SLOTS; slot++) {
+                auto& wheel = _wheels[level][slot];
+                std::move(wheel.begin(), wheel.end(), std::back_inserter(timers));
+                wheel.clear();
+            }
+            _occupied[level] = 0;
+        }
+
+        for (auto* list : {&_overflow, &_due}) {
+            std::move(list->begin(), list->end(), std::back_inserter(timers));
+            list->clear();
+        }
+    }
+};
+
+#endif
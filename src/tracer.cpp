@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <utility>
+
+#include "tracer.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+atomic<uint64_t> next_tracer_id{0};
+
+struct CachedBuffer {
+    uint64_t tracer;
+    void* buffer;
+};
+
+// rings of the calling thread, for each tracer it recorded into. Entries of
+// destroyed tracers are never matched again (ids are not reused).
+thread_local vector<CachedBuffer> thread_buffers;
+
+}
+
+Tracer::Tracer(size_t events_per_thread) :
+                _id(next_tracer_id++),
+                _origin(Clock::now())
+{
+    size_t size = 1;
+    while (size < events_per_thread) size <<= 1;
+    _mask = size - 1;
+}
+
+auto Tracer::buffer() -> Buffer& {
+
+    for (const auto& cached : thread_buffers) {
+        if (cached.tracer == _id) return *static_cast<Buffer*>(cached.buffer);
+    }
+
+    Buffer* buffer;
+    {
+        lock_guard<mutex> lock(_buffers_mutex);
+        _buffers.emplace_back(new Buffer(_mask + 1));
+        buffer = _buffers.back().get();
+        buffer->tid = _buffers.size();
+    }
+    thread_buffers.push_back({_id, buffer});
+
+    return *buffer;
+}
+
+void Tracer::record(const char* name,
+                    int64_t begin,
+                    int64_t duration,
+                    const char* arg_name,
+                    int64_t arg) {
+
+    auto& ring = buffer();
+
+    auto head = ring.head.load(memory_order_relaxed);
+    auto& event = ring.events[head & _mask];
+
+    // pairs with the acquire fence in `write`: a reader that sees any of the
+    // new fields also sees that the slot is being reused
+    atomic_thread_fence(memory_order_release);
+
+    event.name.store(name, memory_order_relaxed);
+    event.arg_name.store(arg_name, memory_order_relaxed);
+    event.begin.store(begin, memory_order_relaxed);
+    event.duration.store(duration, memory_order_relaxed);
+    event.arg.store(arg, memory_order_relaxed);
+
+    ring.head.store(head + 1, memory_order_release);
+}
+
+void Tracer::complete(const char* name,
+                      Clock::time_point begin,
+                      Clock::time_point end,
+                      const char* arg_name,
+                      int64_t arg) {
+    record(name,
+           duration_cast<nanoseconds>(begin - _origin).count(),
+           duration_cast<nanoseconds>(end - begin).count(),
+           arg_name,
+           arg);
+}
+
+void Tracer::instant(const char* name,
+                     const char* arg_name,
+                     int64_t arg) {
+    record(name,
+           duration_cast<nanoseconds>(Clock::now() - _origin).count(),
+           -1,
+           arg_name,
+           arg);
+}
+
+void Tracer::name_thread(const char* name) {
+    buffer().name.store(name, memory_order_relaxed);
+}
+
+void Tracer::write(ostream& os) const {
+
+    struct Copy {
+        const char* name;
+        const char* arg_name;
+        int64_t begin;
+        int64_t duration;
+        int64_t arg;
+    };
+
+    vector<pair<const Buffer*, const char*>> buffers;
+    {
+        lock_guard<mutex> lock(_buffers_mutex);
+        for (const auto& buffer : _buffers) {
+            buffers.emplace_back(buffer.get(), buffer->name.load(memory_order_relaxed));
+        }
+    }
+
+    auto capacity = _mask + 1;
+
+    auto flags = os.flags();
+    auto precision = os.precision();
+    os << fixed << setprecision(3);
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    bool first = true;
+    auto separator = [&os, &first]() {
+        if (!first) os << ",";
+        first = false;
+        os << "\n";
+    };
+
+    vector<Copy> events;
+    for (const auto& entry : buffers) {
+
+        const auto& ring = *entry.first;
+
+        separator();
+        os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring.tid
+           << ",\"args\":{\"name\":\"";
+        if (entry.second) os << entry.second;
+        else os << "thread " << ring.tid;
+        os << "\"}}";
+
+        auto end = ring.head.load(memory_order_acquire);
+        auto begin = end > capacity ? end - capacity : 0;
+
+        events.clear();
+        for (auto i = begin; i < end; i++) {
+            const auto& event = ring.events[i & _mask];
+            events.push_back({event.name.load(memory_order_relaxed),
+                              event.arg_name.load(memory_order_relaxed),
+                              event.begin.load(memory_order_relaxed),
+                              event.duration.load(memory_order_relaxed),
+                              event.arg.load(memory_order_relaxed)});
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+
+        // the events whose slot the thread has started to reuse since may
+        // be torn: keep only the ones that were safe all along
+        auto head = ring.head.load(memory_order_relaxed);
+        auto safe = head >= capacity ? head - capacity + 1 : 0;
+
+        for (auto i = max(begin, safe); i < end; i++) {
+
+            const auto& event = events[i - begin];
+
+            separator();
+            os << "{\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":" << ring.tid
+               << ",\"ts\":" << event.begin / 1e3;
+
+            if (event.duration < 0) os << ",\"ph\":\"i\",\"s\":\"t\"";
+            else os << ",\"ph\":\"X\",\"dur\":" << event.duration / 1e3;
+
+            if (event.arg_name) {
+                os << ",\"args\":{\"" << event.arg_name << "\":" << event.arg << "}";
+            }
+            os << "}";
+        }
+    }
+
+    os << "\n]}\n";
+
+    os.flags(flags);
+    os.precision(precision);
+}
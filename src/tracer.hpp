@@ -0,0 +1,105 @@
+#ifndef TRACER
+#define TRACER
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/** Records timed events from any number of threads, and writes them in the
+ * Chrome trace event format (JSON), which opens in Perfetto
+ * (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * Each thread records into its own ring buffer, allocated the first time it
+ * records: recording never blocks nor allocates afterwards. When a ring is
+ * full, its oldest events are overwritten.
+ *
+ * Event and argument names are not copied: they must be string literals (or
+ * outlive the tracer), and must not need escaping in JSON.
+ */
+class Tracer
+{
+
+public:
+
+    typedef std::chrono::steady_clock Clock;
+
+    /** `events_per_thread` is rounded up to the next power of two.
+     */
+    explicit Tracer(size_t events_per_thread);
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    /** Records an event spanning from `begin` to `end`, with an optional
+     * integer argument.
+     */
+    void complete(const char* name,
+                  Clock::time_point begin,
+                  Clock::time_point end,
+                  const char* arg_name = nullptr,
+                  int64_t arg = 0);
+
+    /** Records an event happening now, with an optional integer argument.
+     */
+    void instant(const char* name,
+                 const char* arg_name = nullptr,
+                 int64_t arg = 0);
+
+    /** Names the calling thread in the trace (threads are otherwise named
+     * 'thread <n>', in the order they first recorded).
+     */
+    void name_thread(const char* name);
+
+    /** Writes the recorded events as Chrome trace JSON. Can be called while
+     * other threads keep recording: events overwritten during the copy are
+     * left out.
+     */
+    void write(std::ostream& os) const;
+
+private:
+
+    // all fields are atomics so that `write` can read a ring while its
+    // thread overwrites it (the reader then discards the torn events)
+    struct Event {
+        std::atomic<const char*> name{nullptr};
+        std::atomic<const char*> arg_name{nullptr};
+        std::atomic<int64_t> begin{0};     // ns since the creation of the tracer
+        std::atomic<int64_t> duration{0};  // ns; -1 for instant events
+        std::atomic<int64_t> arg{0};
+    };
+
+    struct Buffer {
+        explicit Buffer(size_t capacity) : events(new Event[capacity]) {}
+
+        std::unique_ptr<Event[]> events;
+        std::atomic<uint64_t> head{0}; // number of events ever recorded
+        std::atomic<const char*> name{nullptr};
+        size_t tid = 0;
+    };
+
+    // unique across tracers, to recognize them in the per-thread caches
+    uint64_t _id;
+
+    Clock::time_point _origin;
+    size_t _mask;
+
+    mutable std::mutex _buffers_mutex;
+    std::vector<std::unique_ptr<Buffer>> _buffers;
+
+    /** Returns the ring of the calling thread, creating it if needed.
+     */
+    Buffer& buffer();
+
+    void record(const char* name,
+                int64_t begin,
+                int64_t duration,
+                const char* arg_name,
+                int64_t arg);
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "unit_registry.hpp"
+
+using namespace std;
+
+// initial size of the hash index. It is doubled whenever it gets half full.
+const size_t MIN_BUCKETS = 16;
+
+/** 64-bit FNV-1a hash.
+ */
+static size_t hash_name(const char* name, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+}
+
+size_t UnitRegistry::add(const string& name) {
+
+    if (find(name) != npos) {
+        throw runtime_error(name + " is already used. Two units can not have the same name.");
+    }
+
+    if (2 * (_names.size() + 1) > _buckets.size()) {
+        rehash(max(MIN_BUCKETS, 2 * _buckets.size()));
+    }
+
+    auto id = _names.size();
+    auto hash = hash_name(name.data(), name.size());
+
+    _names.push_back(name);
+    _hashes.push_back(hash);
+
+    auto mask = _buckets.size() - 1;
+    auto bucket = hash & mask;
+    while (_buckets[bucket] != 0) bucket = (bucket + 1) & mask;
+    _buckets[bucket] = id + 1;
+
+    _size = _names.size();
+
+    return id;
+}
+
+size_t UnitRegistry::find(const char* name, size_t length) const {
+
+    if (_buckets.empty()) return npos;
+
+    auto hash = hash_name(name, length);
+    auto mask = _buckets.size() - 1;
+
+    for (auto bucket = hash & mask; _buckets[bucket] != 0; bucket = (bucket + 1) & mask) {
+        auto id = _buckets[bucket] - 1;
+        if (_hashes[id] == hash
+            && _names[id].size() == length
+            && memcmp(_names[id].data(), name, length) == 0) {
+            return id;
+        }
+    }
+    return npos;
+}
+
+void UnitRegistry::reserve(size_t count) {
+
+    _names.reserve(count);
+    _hashes.reserve(count);
+
+    size_t nb_buckets = max(MIN_BUCKETS, _buckets.size());
+    while (nb_buckets < 2 * count) nb_buckets *= 2;
+    if (nb_buckets > _buckets.size()) rehash(nb_buckets);
+}
+
+void UnitRegistry::clear() {
+
+    _size = 0;
+    _names.clear();
+    _hashes.clear();
+    _buckets.assign(_buckets.size(), 0);
+}
+
+void UnitRegistry::rehash(size_t nb_buckets) {
+
+    _buckets.assign(nb_buckets, 0);
+    auto mask = nb_buckets - 1;
+
+    for (size_t id = 0; id < _names.size(); id++) {
+        auto bucket = _hashes[id] & mask;
+        while (_buckets[bucket] != 0) bucket = (bucket + 1) & mask;
+        _buckets[bucket] = id + 1;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef UNIT_REGISTRY
+#define UNIT_REGISTRY
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/** Maps unit names to their internal IDs (and back).
+ *
+ * Each name is stored once, in ID order. Lookups go through an
+ * open-addressing hash index over these names, and are O(1). They can be
+ * made from any character buffer (see `find(const char*, size_t)`), without
+ * building a temporary `std::string`.
+ */
+class UnitRegistry
+{
+
+public:
+
+    /** Returned by `find` when the name is not registered.
+     */
+    static const size_t npos = static_cast<size_t>(-1);
+
+    /** Registers a new name and returns its ID. IDs are allocated
+     * consecutively, starting from 0.
+     *
+     * Raises a `runtime_error` if the name is already registered.
+     */
+    size_t add(const std::string& name);
+
+    /** Returns the ID of the name stored in `name[0..length)`, or `npos`.
+     */
+    size_t find(const char* name, size_t length) const;
+    size_t find(const std::string& name) const {return find(name.data(), name.size());}
+
+    const std::string& name(size_t id) const {return _names[id];}
+    const std::vector<std::string>& names() const {return _names;}
+
+    /** Number of registered names. Safe to call from any thread.
+     */
+    size_t size() const {return _size;}
+
+    /** Pre-allocates room for `count` names.
+     */
+    void reserve(size_t count);
+
+    /** Removes all the names: IDs start again from 0.
+     */
+    void clear();
+
+private:
+
+    std::vector<std::string> _names;
+    std::vector<size_t> _hashes; // hash of each name, by ID
+
+    // open-addressing (linear probing) index. Each bucket stores ID + 1, or
+    // 0 if empty.
+    std::vector<size_t> _buckets;
+
+    std::atomic<size_t> _size{0};
+
+    void rehash(size_t nb_buckets);
+};
+
+#endif
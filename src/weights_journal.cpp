@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <cstdio> // rename
+#include <iostream>
+#include <stdexcept>
+
+#include "weights_journal.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+// journal files start with this magic number, followed by the version of the
+// format and the size of the scalars. Values are stored in the native byte
+// order.
+const char JOURNAL_MAGIC[4] = {'A', 'M', 'W', 'J'};
+const uint32_t JOURNAL_VERSION = 1;
+const size_t JOURNAL_HEADER_SIZE = sizeof(JOURNAL_MAGIC) + 2 * sizeof(uint32_t);
+
+// how often the writer thread drains the ring, between two flushes
+const microseconds DRAIN_PERIOD = milliseconds(1);
+
+template<typename T>
+void append(string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool extract(const char*& data, const char* end, T& value) {
+    if (size_t(end - data) < sizeof(T)) return false;
+    copy(data, data + sizeof(T), reinterpret_cast<char*>(&value));
+    data += sizeof(T);
+    return true;
+}
+
+// 64-bit FNV-1a
+uint64_t checksum(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template<typename Scalar>
+void write_header(ostream& os) {
+    os.write(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    os.write(reinterpret_cast<const char*>(&JOURNAL_VERSION), sizeof(JOURNAL_VERSION));
+    uint32_t scalar_size = sizeof(Scalar);
+    os.write(reinterpret_cast<const char*>(&scalar_size), sizeof(scalar_size));
+}
+
+// the changes are compacted by pair of units (the IDs are below MAX_UNITS,
+// see `add_units`)
+uint64_t pair_key(size_t i, size_t j) {
+    return uint64_t(i) << 32 | uint64_t(j);
+}
+
+/** Decodes the payload of a frame. Returns false if it is malformed.
+ */
+template<typename Frame>
+bool parse_frame(const string& payload, uint32_t scalar_size, Frame& frame) {
+
+    auto data = payload.data();
+    auto end = data + payload.size();
+
+    uint64_t nb_units, nb_changes;
+    if (!extract(data, end, frame.sequence) || !extract(data, end, nb_units)) return false;
+
+    for (uint64_t k = 0; k < nb_units; k++) {
+        uint64_t id;
+        uint32_t length;
+        if (!extract(data, end, id) || !extract(data, end, length)) return false;
+        if (size_t(end - data) < length) return false;
+        frame.units.emplace_back(id, string(data, data + length));
+        data += length;
+    }
+
+    if (!extract(data, end, nb_changes)) return false;
+    if (nb_changes != size_t(end - data) / (2 * sizeof(uint64_t) + scalar_size)) return false;
+
+    frame.changes.resize(nb_changes);
+    for (auto& change : frame.changes) {
+        uint64_t i, j;
+        if (!extract(data, end, i) || !extract(data, end, j)) return false;
+        change.i = i;
+        change.j = j;
+
+        // journals of the other precision are converted
+        if (scalar_size == sizeof(float)) {
+            float weight;
+            if (!extract(data, end, weight)) return false;
+            change.weight = weight;
+        }
+        else {
+            double weight;
+            if (!extract(data, end, weight)) return false;
+            change.weight = weight;
+        }
+    }
+
+    return data == end;
+}
+
+}
+
+template<typename Scalar>
+BasicWeightsJournal<Scalar>::BasicWeightsJournal(const string& filename,
+                                                 microseconds flush_period,
+                                                 size_t capacity) :
+                _filename(filename),
+                _flush_period(flush_period),
+                _ring(capacity),
+                _file(filename, ios::binary | ios::trunc)
+{
+    if (!_file) {
+        throw runtime_error("Can not open " + filename + " to write the journal.");
+    }
+
+    write_header<Scalar>(_file);
+    _file.flush();
+    if (!_file) {
+        throw runtime_error("Error while writing the journal to " + filename);
+    }
+
+    _writing = true;
+    _writer = thread(&BasicWeightsJournal::write, this);
+}
+
+template<typename Scalar>
+BasicWeightsJournal<Scalar>::~BasicWeightsJournal() {
+
+    if (!_writer.joinable()) return;
+
+    try {
+        stop();
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+    }
+}
+
+template<typename Scalar>
+auto BasicWeightsJournal<Scalar>::claim() -> vector<Change>& {
+
+    Step* step;
+    while (!(step = _ring.claim())) this_thread::yield();
+
+    step->changes.clear();
+    return step->changes;
+}
+
+template<typename Scalar>
+void BasicWeightsJournal<Scalar>::publish(uint64_t sequence) {
+
+    // the slot returned by the last `claim`
+    auto step = _ring.claim();
+    step->sequence = sequence;
+    _ring.publish();
+}
+
+template<typename Scalar>
+void BasicWeightsJournal<Scalar>::add_units(size_t first_id, const vector<string>& names) {
+
+    if (uint64_t(first_id) + names.size() > MAX_UNITS) {
+        throw runtime_error("The journal can not hold more than " + to_string(MAX_UNITS) + " units.");
+    }
+
+    lock_guard<mutex> lock(_units_mutex);
+    for (size_t k = 0; k < names.size(); k++) {
+        _units.emplace_back(first_id + k, names[k]);
+    }
+}
+
+template<typename Scalar>
+void BasicWeightsJournal<Scalar>::compact(uint64_t sequence, size_t nb_units) {
+
+    lock_guard<mutex> lock(_compaction_mutex);
+    _compaction_requested = true;
+    _compaction_sequence = sequence;
+    _compaction_units = nb_units;
+}
+
+template<typename Scalar>
+void BasicWeightsJournal<Scalar>::stop() {
+
+    if (!_writer.joinable()) return;
+
+    {
+        lock_guard<mutex> lock(_writer_mutex);
+        _writing = false;
+    }
+    _writer_condition.notify_one();
+    _writer.join();
+
+    if (_failed) {
+        throw runtime_error("The journal " + _filename + " could not be written: it is incomplete.");
+    }
+}
+
+template<typename Scalar>
+void BasicWeightsJournal<Scalar>::write() {
+
+    auto last_flush = steady_clock::now();
+
+    for (;;) {
+
+        bool writing;
+        {
+            unique_lock<mutex> lock(_writer_mutex);
+            _writer_condition.wait_for(lock, DRAIN_PERIOD, [this]() {return !_writing;});
+            writing = _writing;
+        }
+
+        drain();
+
+        if (writing && steady_clock::now() - last_flush < _flush_period) continue;
+        last_flush = steady_clock::now();
+
+        // once the journal failed, only keep draining, so that the network
+        // is not blocked
+        if (_failed) {
+            _pending.clear();
+            lock_guard<mutex> lock(_units_mutex);
+            _units.clear();
+        }
+        else {
+            try {
+                flush();
+
+                unique_lock<mutex> lock(_compaction_mutex);
+                if (_compaction_requested) {
+                    _compaction_requested = false;
+                    auto sequence = _compaction_sequence;
+                    auto nb_units = _compaction_units;
+                    lock.unlock();
+
+                    drop_frames(sequence, nb_units);
+                }
+            }
+            catch (const exception& e) {
+                cerr << e.what() << endl;
+                _failed = true;
+            }
+        }
+
+        if (!writing) break;
+    }
+}
+
+template<typename Scalar>
+void BasicWeightsJournal<Scalar>::drain() {
+
+    Step* step;
+    while ((step = _ring.front())) {
+        for (const auto& change : step->changes) {
+            _pending[pair_key(change.i, change.j)] = change.weight;
+        }
+        _pending_sequence = step->sequence;
+        _ring.release();
+    }
+}
+
+template<typename Scalar>
+void BasicWeightsJournal<Scalar>::flush() {
+
+    // after draining the ring: the units of the changes drained are either
+    // already written, or in this frame (units are registered here before
+    // the network steps them, see `BasicMemoryNetwork::add_unit`)
+    vector<pair<size_t, string>> units;
+    {
+        lock_guard<mutex> lock(_units_mutex);
+        units.swap(_units);
+    }
+
+    if (units.empty() && _pending.empty()) return;
+
+    string payload;
+    append(payload, uint64_t(_pending_sequence));
+
+    size_t units_end = 0;
+    append(payload, uint64_t(units.size()));
+    for (const auto& unit : units) {
+        append(payload, uint64_t(unit.first));
+        append(payload, uint32_t(unit.second.size()));
+        payload.append(unit.second);
+        units_end = max(units_end, unit.first + 1);
+    }
+
+    append(payload, uint64_t(_pending.size()));
+    for (const auto& change : _pending) {
+        append(payload, uint64_t(change.first >> 32));
+        append(payload, uint64_t(change.first & 0xffffffff));
+        append(payload, change.second);
+    }
+    _pending.clear();
+
+    string header;
+    append(header, uint64_t(payload.size()));
+    append(header, checksum(payload.data(), payload.size()));
+
+    _file.write(header.data(), header.size());
+    _file.write(payload.data(), payload.size());
+    _file.flush();
+    if (!_file) {
+        throw runtime_error("Error while writing the journal to " + _filename);
+    }
+
+    FrameInfo frame;
+    frame.offset = JOURNAL_HEADER_SIZE + _size;
+    frame.size = header.size() + payload.size();
+    frame.sequence = _pending_sequence;
+    frame.units_end = units_end;
+    _frames.push_back(frame);
+
+    _size += frame.size;
+}
+
+template<typename Scalar>
+void BasicWeightsJournal<Scalar>::drop_frames(uint64_t sequence, size_t nb_units) {
+
+    vector<FrameInfo> kept;
+    for (const auto& frame : _frames) {
+        if (frame.sequence > sequence || frame.units_end > nb_units) kept.push_back(frame);
+    }
+    if (kept.size() == _frames.size()) return;
+
+    // write the frames kept to a new journal, then replace the current one
+    // with it: a crash leaves either of them, both valid
+    auto filename = _filename + ".tmp";
+    uint64_t offset = JOURNAL_HEADER_SIZE;
+    {
+        ifstream current(_filename, ios::binary);
+        ofstream compacted(filename, ios::binary | ios::trunc);
+
+        write_header<Scalar>(compacted);
+
+        vector<char> buffer;
+        for (auto& frame : kept) {
+            buffer.resize(frame.size);
+            current.seekg(frame.offset);
+            current.read(buffer.data(), buffer.size());
+            compacted.write(buffer.data(), buffer.size());
+
+            frame.offset = offset;
+            offset += frame.size;
+        }
+
+        compacted.flush();
+        if (!current || !compacted) {
+            throw runtime_error("Error while compacting the journal " + _filename);
+        }
+    }
+
+    _file.close();
+    if (rename(filename.c_str(), _filename.c_str()) != 0) {
+        throw runtime_error("Can not replace the journal " + _filename + " by its compacted version.");
+    }
+    _file.open(_filename, ios::binary | ios::app);
+    if (!_file) {
+        throw runtime_error("Can not reopen the journal " + _filename);
+    }
+
+    _frames.swap(kept);
+    _size = offset - JOURNAL_HEADER_SIZE;
+}
+
+template<typename Scalar>
+auto BasicWeightsJournal<Scalar>::read(const string& filename) -> vector<Frame> {
+
+    ifstream file(filename, ios::binary);
+    if (!file) {
+        throw runtime_error("Can not open the journal " + filename);
+    }
+
+    char magic[sizeof(JOURNAL_MAGIC)];
+    uint32_t version, scalar_size;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&scalar_size), sizeof(scalar_size));
+    if (!file || !equal(magic, magic + sizeof(magic), JOURNAL_MAGIC)) {
+        throw runtime_error(filename + " is not a memory network journal.");
+    }
+    if (version != JOURNAL_VERSION) {
+        throw runtime_error("Unsupported journal version " + to_string(version)
+                            + " (expected " + to_string(JOURNAL_VERSION) + ").");
+    }
+    if (scalar_size != sizeof(float) && scalar_size != sizeof(double)) {
+        throw runtime_error("Corrupted journal: invalid scalar size.");
+    }
+
+    file.seekg(0, ios::end);
+    uint64_t file_size = file.tellg();
+    file.seekg(JOURNAL_HEADER_SIZE);
+
+    vector<Frame> frames;
+    string payload;
+
+    for (;;) {
+
+        uint64_t size, stored_checksum;
+        file.read(reinterpret_cast<char*>(&size), sizeof(size));
+        if (!file) break; // end of the journal
+        file.read(reinterpret_cast<char*>(&stored_checksum), sizeof(stored_checksum));
+
+        // each frame starts with the size of its payload and a checksum of it
+        auto remaining = file ? file_size - uint64_t(file.tellg()) : 0;
+        payload.resize(min(size, remaining));
+        file.read(&payload[0], payload.size());
+
+        if (!file || size > remaining || checksum(payload.data(), payload.size()) != stored_checksum) {
+            cerr << "Ignoring the incomplete end of the journal " << filename << endl;
+            break;
+        }
+
+        Frame frame;
+        if (!parse_frame(payload, scalar_size, frame)) {
+            cerr << "Ignoring the corrupted end of the journal " << filename << endl;
+            break;
+        }
+
+        frames.push_back(move(frame));
+    }
+
+    return frames;
+}
+
+template class BasicWeightsJournal<double>;
+template class BasicWeightsJournal<float>;
@@ -0,0 +1,183 @@
+#ifndef WEIGHTS_JOURNAL
+#define WEIGHTS_JOURNAL
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "spsc_ring.hpp"
+
+/** A write-ahead journal of the weights learnt by a network, since its last
+ * base image (a checkpoint, see `BasicMemoryNetwork::journal`).
+ *
+ * After each step, the network thread pushes the weights that step changed
+ * (or created) into a ring. A background thread compacts them per pair of
+ * units (only the latest weight of each pair is kept), and appends them to
+ * the journal file every `flush_period`, as a checksummed frame. The
+ * journal stores weights, not deltas: replaying it is exact, and
+ * idempotent.
+ *
+ * The frames are tagged with the sequence number of the last step they
+ * include, so that the frames already folded into a new base image can be
+ * dropped (see `compact`).
+ */
+template<typename Scalar>
+class BasicWeightsJournal
+{
+
+public:
+
+    /** The changes are compacted by pair of units, on a 64-bit key: the
+     * IDs of the units must fit in 32 bits.
+     */
+    static const uint64_t MAX_UNITS = uint64_t(1) << 32;
+
+    struct Change {
+        size_t i;
+        size_t j;
+        Scalar weight;
+    };
+
+    /** A frame of the journal, as read back by `read`.
+     */
+    struct Frame {
+        uint64_t sequence; // of the last step included
+        std::vector<std::pair<size_t, std::string>> units; // new units (ID, name)
+        std::vector<Change> changes;
+    };
+
+    /** Creates (or truncates) the journal file, and starts the writer
+     * thread. `capacity` is the number of steps the ring can hold: when it
+     * is full, the network waits for the writer thread.
+     *
+     * Raises a `runtime_error` if the file can not be created.
+     */
+    BasicWeightsJournal(const std::string& filename,
+                        std::chrono::microseconds flush_period = std::chrono::milliseconds(100),
+                        size_t capacity = 256);
+
+    ~BasicWeightsJournal();
+
+    BasicWeightsJournal(const BasicWeightsJournal&) = delete;
+    BasicWeightsJournal& operator=(const BasicWeightsJournal&) = delete;
+
+    const std::string& filename() const {return _filename;}
+
+    /** Returns the (cleared) list of changes of the next step, to be filled
+     * then published with `publish`. Waits for the writer thread if the
+     * ring is full.
+     *
+     * *Must only be called from a single (producer) thread.*
+     */
+    std::vector<Change>& claim();
+    void publish(uint64_t sequence);
+
+    /** Records new units, `first_id` being the ID of the first one. Can be
+     * called from any thread.
+     *
+     * Raises a `runtime_error` if the IDs reach `MAX_UNITS`.
+     */
+    void add_units(size_t first_id, const std::vector<std::string>& names);
+
+    /** Drops the frames already folded into a base image: the ones that
+     * only contain steps up to `sequence`, and units below `nb_units`. Done
+     * by the writer thread, at its next flush.
+     */
+    void compact(uint64_t sequence, size_t nb_units);
+
+    /** Writes the pending changes, and stops the writer thread.
+     *
+     * Raises a `runtime_error` if the journal could not be written.
+     */
+    void stop();
+
+    /** Number of bytes of frames written to the journal file (after the
+     * last compaction).
+     */
+    size_t size() const {return _size;}
+
+    /** Reads the frames of a journal file, up to the first incomplete (or
+     * corrupted) one: the end of a journal that was being written when the
+     * process crashed is ignored.
+     *
+     * Raises a `runtime_error` if the file is not a journal.
+     */
+    static std::vector<Frame> read(const std::string& filename);
+
+private:
+
+    struct Step {
+        uint64_t sequence;
+        std::vector<Change> changes;
+    };
+
+    std::string _filename;
+    std::chrono::microseconds _flush_period;
+
+    SPSCRing<Step> _ring;
+
+    // new units, not written yet
+    std::mutex _units_mutex;
+    std::vector<std::pair<size_t, std::string>> _units;
+
+    // writer thread only: the compacted changes not written yet (by pair of
+    // units), and the frames of the file
+    std::unordered_map<uint64_t, Scalar> _pending;
+    uint64_t _pending_sequence = 0;
+
+    struct FrameInfo {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t sequence;
+        size_t units_end; // 1 + highest unit ID, 0 if none
+    };
+    std::vector<FrameInfo> _frames;
+
+    std::ofstream _file;
+    std::atomic<size_t> _size{0};
+    std::atomic<bool> _failed{false};
+
+    // requested by `compact`, under `_compaction_mutex`
+    std::mutex _compaction_mutex;
+    bool _compaction_requested = false;
+    uint64_t _compaction_sequence = 0;
+    size_t _compaction_units = 0;
+
+    std::thread _writer;
+    std::atomic<bool> _writing{false};
+    std::mutex _writer_mutex;
+    std::condition_variable _writer_condition;
+
+    void write();
+
+    /** Drains the ring into `_pending`.
+     */
+    void drain();
+
+    /** Writes the pending units and changes as a new frame, if any.
+     */
+    void flush();
+
+    /** Rewrites the journal file without the frames folded into the base
+     * image.
+     */
+    void drop_frames(uint64_t sequence, size_t nb_units);
+};
+
+// instantiated (and exported) by the library
+extern template class BasicWeightsJournal<double>;
+extern template class BasicWeightsJournal<float>;
+
+typedef BasicWeightsJournal<double> WeightsJournal;
+typedef BasicWeightsJournal<float> WeightsJournalf;
+
+#endif
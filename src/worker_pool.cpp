@@ -0,0 +1,68 @@
+#include "worker_pool.hpp"
+
+using namespace std;
+
+WorkerPool::WorkerPool(size_t nb_threads) {
+
+    for (size_t i = 1; i < nb_threads; i++) {
+        _workers.emplace_back(&WorkerPool::work, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+
+    for (auto& worker : _workers) worker.join();
+}
+
+void WorkerPool::run(size_t nb_tasks, const function<void(size_t)>& task) {
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _task = &task;
+        _nb_tasks = nb_tasks;
+        _next_task = 0;
+        _busy_workers = _workers.size();
+        _generation++;
+    }
+    _wakeup.notify_all();
+
+    run_tasks();
+
+    unique_lock<mutex> lock(_mutex);
+    _done.wait(lock, [this]() {return _busy_workers == 0;});
+    _task = nullptr;
+}
+
+void WorkerPool::work() {
+
+    size_t generation = 0;
+
+    for (;;) {
+        {
+            unique_lock<mutex> lock(_mutex);
+            _wakeup.wait(lock, [this, generation]() {return _stopping || _generation != generation;});
+            if (_stopping) return;
+            generation = _generation;
+        }
+
+        run_tasks();
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            if (--_busy_workers == 0) _done.notify_one();
+        }
+    }
+}
+
+void WorkerPool::run_tasks() {
+
+    for (auto i = _next_task++; i < _nb_tasks; i = _next_task++) {
+        (*_task)(i);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef WORKER_POOL
+#define WORKER_POOL
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A fixed set of persistent threads, used to split the work of one network
+ * step.
+ *
+ * The threads are created once, and sleep between two calls to `run`. The
+ * thread calling `run` takes part in the work.
+ */
+class WorkerPool
+{
+
+public:
+
+    /** Creates a pool of `nb_threads` threads, including the caller's
+     * thread: `nb_threads - 1` threads are actually spawned.
+     */
+    explicit WorkerPool(size_t nb_threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /** Number of threads in the pool, including the caller's thread.
+     */
+    size_t size() const {return _workers.size() + 1;}
+
+    /** Calls `task(0)`, ..., `task(nb_tasks - 1)`, spread over all the
+     * threads of the pool, and returns once they are all completed.
+     *
+     * Tasks are handed out dynamically: which thread runs which task is not
+     * deterministic. *Must not be called concurrently.*
+     */
+    void run(size_t nb_tasks, const std::function<void(size_t)>& task);
+
+private:
+
+    std::vector<std::thread> _workers;
+
+    std::mutex _mutex;
+    std::condition_variable _wakeup;
+    std::condition_variable _done;
+
+    // incremented (under `_mutex`) each time `run` hands out a new batch
+    size_t _generation = 0;
+    bool _stopping = false;
+
+    const std::function<void(size_t)>* _task = nullptr;
+    size_t _nb_tasks = 0;
+    std::atomic<size_t> _next_task{0};
+
+    // workers that have not finished the current batch yet
+    size_t _busy_workers = 0;
+
+    void work();
+    void run_tasks();
+};
+
+#endif
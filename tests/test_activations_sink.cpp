@@ -0,0 +1,57 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include "activations_sink.hpp"
+
+// Pushes samples larger than the initial allocation of a sink, once
+// reserved for them: pushing must not allocate, including for the samples
+// that were pending (held by the consumer) when the sink was reserved.
+
+using namespace std;
+using namespace std::chrono;
+
+static atomic<size_t> nb_allocations{0};
+
+void* operator new(size_t size) {
+    nb_allocations++;
+    if (auto p = malloc(size)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {free(p);}
+void operator delete(void* p, size_t) noexcept {free(p);}
+
+const size_t CAPACITY = 8;
+const size_t UNITS = 1000;
+
+int main() {
+
+    ActivationsSink sink(CAPACITY, 0, OverflowPolicy::Drop, 16);
+    ActivationsSink::Vector activations = ActivationsSink::Vector::Ones(UNITS);
+
+    size_t nb_consumed = 0;
+    auto consume = [&nb_consumed](microseconds, const ActivationsSink::VectorRef&) {nb_consumed++;};
+
+    // half of the samples are pending when the sink grows
+    for (size_t k = 0; k < CAPACITY / 2; k++) sink.push(microseconds(k), activations.head(16));
+    sink.reserve(UNITS);
+    sink.poll(consume);
+
+    auto before = nb_allocations.load();
+    for (size_t lap = 0; lap < 4; lap++) {
+        for (size_t k = 0; k < CAPACITY; k++) sink.push(microseconds(k), activations);
+        sink.poll(consume);
+    }
+    auto allocations = nb_allocations.load() - before;
+
+    if (allocations != 0) {
+        cerr << allocations << " allocations while pushing " << 4 * CAPACITY << " samples" << endl;
+        return 1;
+    }
+
+    cout << nb_consumed << " samples, without allocation" << endl;
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+#include "memory_network.hpp"
+
+// Saves a checkpoint of a running dense network, large enough for its
+// weights to be captured over several steps, while a few units at both ends
+// of the network learn. All the weights between these units are equal at
+// any step: they must be equal in the checkpoint too.
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t UNITS = 1536;
+const size_t LEARNING_UNITS[] = {0, 1, UNITS - 2, UNITS - 1};
+
+const string CHECKPOINT = "test_checkpoint_capture.ckpt";
+
+int main() {
+
+    MemoryNetwork network;
+    for (size_t i = 0; i < UNITS; i++) network.add_unit("unit" + to_string(i));
+
+    for (auto id : LEARNING_UNITS) network.activate_unit(id, 1.0, seconds(100));
+
+    network.start();
+    this_thread::sleep_for(milliseconds(100));
+    network.save_checkpoint(CHECKPOINT);
+    network.stop();
+
+    MemoryNetwork restored;
+    restored.load_checkpoint(CHECKPOINT);
+    remove(CHECKPOINT.c_str());
+
+    auto expected = restored.weight(LEARNING_UNITS[0], LEARNING_UNITS[1]);
+    if (!(expected > 0)) {
+        cerr << "The units did not learn before the checkpoint" << endl;
+        return 1;
+    }
+
+    for (auto i : LEARNING_UNITS) {
+        for (auto j : LEARNING_UNITS) {
+            if (i == j) continue;
+            if (restored.weight(i, j) != expected) {
+                cerr << "Weight " << i << " - " << j << " is " << restored.weight(i, j)
+                     << " instead of " << expected << ": the weights come from different steps" << endl;
+                return 1;
+            }
+        }
+    }
+
+    cout << "Consistent weights in the checkpoint: " << expected << endl;
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "memory_network.hpp"
+
+// Overwrites, in turn, every 8 bytes of a small checkpoint with a huge
+// value: loading it must either succeed or fail with a `runtime_error`,
+// never try to allocate for the corrupted counts.
+
+using namespace std;
+using namespace std::chrono;
+
+const string CHECKPOINT = "test_checkpoint_corruption.ckpt";
+
+int main() {
+
+    MemoryNetwork network;
+    for (size_t i = 0; i < 4; i++) network.add_unit("unit" + to_string(i));
+    network.schedule_activation(0, 1.0, milliseconds(10), milliseconds(5));
+    network.save_checkpoint(CHECKPOINT);
+
+    string original;
+    {
+        ifstream file(CHECKPOINT, ios::binary);
+        original.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+
+    size_t nb_rejected = 0;
+    for (size_t offset = 0; offset + 8 <= original.size(); offset++) {
+
+        auto corrupted = original;
+        corrupted.replace(offset, 8, string(7, char(0xff)) + char(0x0f));
+        {
+            ofstream file(CHECKPOINT, ios::binary | ios::trunc);
+            file.write(corrupted.data(), corrupted.size());
+        }
+
+        MemoryNetwork restored;
+        try {
+            restored.load_checkpoint(CHECKPOINT);
+        } catch (const runtime_error&) {
+            nb_rejected++;
+        } catch (const exception& e) {
+            cerr << "Corruption at byte " << offset << ": " << e.what() << " instead of a runtime_error" << endl;
+            remove(CHECKPOINT.c_str());
+            return 1;
+        }
+    }
+    remove(CHECKPOINT.c_str());
+
+    cout << nb_rejected << " corrupted checkpoints rejected, out of " << original.size() - 7 << endl;
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include "memory_network.hpp"
+#include "parser.hpp"
+
+// Runs experiments/experiment-colors.md in simulated time with both
+// MemoryNetwork (double) and MemoryNetworkf (float), and checks that the
+// activations and the weights of the two networks stay close. The
+// experiment is read with the runner's parser.
+
+using namespace std;
+using namespace std::chrono;
+
+const string EXPERIMENT = "experiments/experiment-colors.md";
+
+const double MAX_ACTIVATION_DIVERGENCE = 1e-6;
+const double MAX_WEIGHT_DIVERGENCE = 1e-6;
+
+static Experiment read_experiment(const string& filename) {
+
+    ifstream file(filename);
+    if (!file) throw runtime_error("Can not open " + filename);
+
+    string str((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    auto iter = str.cbegin();
+
+    experiment_grammar<string::const_iterator> parser;
+    if (!qi::phrase_parse(iter, str.cend(), parser, ascii::space) || iter != str.cend()) {
+        throw runtime_error("Parsing of " + filename + " failed");
+    }
+
+    return parser.expe;
+}
+
+template<typename Scalar>
+void setup(BasicMemoryNetwork<Scalar>& network, const Experiment& experiment) {
+
+    network.use_physical_time(false);
+
+    for (const auto& parameter : experiment.parameters) {
+        if (parameter.first == "MaxFreq") network.max_frequency(parameter.second);
+        else network.set_parameter(parameter.first, parameter.second);
+    }
+
+    for (const auto& unit : experiment.units) network.add_unit(unit);
+}
+
+int main() {
+
+    auto experiment = read_experiment(EXPERIMENT);
+    if (experiment.units.empty() || experiment.activations.empty()) {
+        cerr << "Failed to read " << EXPERIMENT << endl;
+        return 1;
+    }
+
+    MemoryNetwork reference;
+    MemoryNetworkf network;
+    setup(reference, experiment);
+    setup(network, experiment);
+
+    auto n = experiment.units.size();
+    double activation_divergence = 0, weight_divergence = 0;
+
+    int duration = experiment.duration.count() + 50;
+    for (int ms = 0; ms < duration; ms++) {
+
+        auto scheduled = experiment.activations.find(ms);
+        if (scheduled != experiment.activations.end()) {
+            for (const auto& activation : scheduled->second) {
+                string name;
+                float level;
+                milliseconds length;
+                tie(name, level, length) = activation;
+
+                reference.activate_unit(name, level, length);
+                network.activate_unit(name, level, length);
+            }
+        }
+
+        reference.run_for(milliseconds(1));
+        network.run_for(milliseconds(1));
+
+        auto reference_activations = reference.activations();
+        auto activations = network.activations();
+        for (size_t i = 0; i < n; i++) {
+            activation_divergence = max(activation_divergence,
+                                        abs(reference_activations(i) - double(activations(i))));
+
+            for (size_t j = 0; j < n; j++) {
+                auto w = reference.weight(i, j);
+                if (std::isnan(w)) continue;
+                weight_divergence = max(weight_divergence, abs(w - double(network.weight(i, j))));
+            }
+        }
+    }
+
+    cout << "Divergence of float from double over " << duration << "ms: "
+         << activation_divergence << " (activations), "
+         << weight_divergence << " (weights)" << endl;
+
+    if (activation_divergence > MAX_ACTIVATION_DIVERGENCE ||
+        weight_divergence > MAX_WEIGHT_DIVERGENCE) {
+        cerr << "The float network diverges from the double one" << endl;
+        return 1;
+    }
+
+    return 0;
+}
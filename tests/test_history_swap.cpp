@@ -0,0 +1,54 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+#include "memory_network.hpp"
+
+// Replaces the activations history of a running network with one covering
+// the units added since, and checks that the network switches to it.
+
+using namespace std;
+using namespace std::chrono;
+
+int main() {
+
+    MemoryNetwork network;
+    network.max_frequency(1000);
+    network.add_unit("unit0");
+
+    auto initial = make_shared<ActivationsHistory>(vector<size_t>{0}, 1024, 0);
+    network.log_history(initial);
+
+    network.start();
+    this_thread::sleep_for(milliseconds(50));
+
+    auto id = network.add_unit("unit1");
+    auto grown = make_shared<ActivationsHistory>(vector<size_t>{0, id}, 1024, 0);
+    network.log_history(grown);
+
+    this_thread::sleep_for(milliseconds(50));
+    auto initial_size = initial->size();
+    this_thread::sleep_for(milliseconds(50));
+
+    network.stop();
+
+    if (initial->size() != initial_size) {
+        cerr << "The network still records to the previous history" << endl;
+        return 1;
+    }
+
+    vector<microseconds> times;
+    vector<double> levels;
+    grown->read(id, times, levels);
+
+    if (levels.empty() || std::isnan(levels.back())) {
+        cerr << "The new history has no sample of the new unit" << endl;
+        return 1;
+    }
+
+    cout << initial_size << " samples in the initial history, "
+         << levels.size() << " in the new one" << endl;
+
+    return 0;
+}
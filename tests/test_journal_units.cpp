@@ -0,0 +1,88 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include "memory_network.hpp"
+
+// Adds units to a running, journaling network, each one learning as soon
+// as possible with the first unit, then recovers the journal: it must hold
+// all the units and the same weights. A failed `add_units` (duplicate
+// name) must neither add units to the network nor to the journal.
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t UNITS = 200;
+
+const string JOURNAL = "test_journal_units.journal";
+
+bool rejects(MemoryNetwork& network, const vector<string>& names) {
+    try {
+        network.add_units(names);
+    } catch (const runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+int main() {
+
+    MemoryNetwork network;
+    network.max_frequency(1000);
+    network.add_unit("unit0");
+    network.journal(JOURNAL);
+
+    network.activate_unit(0, 1.0, seconds(100));
+    network.start();
+
+    for (size_t i = 1; i < UNITS; i++) {
+        auto id = network.add_unit("unit" + to_string(i));
+        network.activate_unit(id, 1.0, seconds(100));
+        this_thread::sleep_for(microseconds(200));
+    }
+
+    if (!rejects(network, {"new0", "new1", "new0"}) || !rejects(network, {"new2", "unit1"})) {
+        cerr << "add_units accepted a duplicate name" << endl;
+        return 1;
+    }
+    for (auto name : {"new0", "new1", "new2"}) {
+        if (network.has_unit(name)) {
+            cerr << "A failed add_units added " << name << endl;
+            return 1;
+        }
+    }
+
+    network.stop();
+
+    // the activations of units the network had not resized for yet were
+    // skipped: the next step resizes before applying these ones
+    for (size_t i = 1; i < UNITS; i++) network.activate_unit(i, 1.0, seconds(100));
+    network.run_for(milliseconds(20));
+
+    network.stop_journal();
+
+    MemoryNetwork recovered;
+    recovered.recover(JOURNAL);
+    remove(JOURNAL.c_str());
+    remove((JOURNAL + ".base").c_str());
+
+    if (recovered.units_names() != network.units_names()) {
+        cerr << "The recovered units differ from the network ones" << endl;
+        return 1;
+    }
+
+    for (size_t i = 1; i < UNITS; i++) {
+        if (std::isnan(network.weight(0, i)) || recovered.weight(0, i) != network.weight(0, i)) {
+            cerr << "Weight 0 - " << i << " is " << recovered.weight(0, i)
+                 << " once recovered instead of " << network.weight(0, i) << endl;
+            return 1;
+        }
+    }
+
+    cout << recovered.units_names().size() << " units recovered" << endl;
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "memory_network.hpp"
+
+// Saves a weights file, then sets some of its connectivity flags (the last
+// n^2 bytes of the file, column-major) to values other than 0 or 1: the
+// mapped network must read any non-zero flag as a connection.
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t UNITS = 64;
+
+const string WEIGHTS = "test_mapped_connectivity.weights";
+
+// sets the flag of the connection from unit i to unit j
+void set_flag(size_t i, size_t j, char flag) {
+    fstream file(WEIGHTS, ios::binary | ios::in | ios::out);
+    file.seekp(-streamoff(UNITS * UNITS - (j * UNITS + i)), ios::end);
+    file.put(flag);
+}
+
+int main() {
+
+    MemoryNetwork source;
+    for (size_t i = 0; i < UNITS; i++) source.add_unit("unit" + to_string(i));
+    source.use_physical_time(false);
+    source.max_frequency(1000);
+    source.activate_unit(0, 1.0, milliseconds(10));
+    source.activate_unit(1, 1.0, milliseconds(10));
+    source.run_for(milliseconds(10));
+    source.save_weights(WEIGHTS);
+
+    set_flag(0, 1, 2);
+    set_flag(2, 3, char(255));
+
+    MemoryNetwork network;
+    network.map_weights(WEIGHTS);
+    remove(WEIGHTS.c_str());
+
+    if (!(network.weight(0, 1) > 0) || network.weight(0, 1) != source.weight(0, 1)) {
+        cerr << "Weight 0 - 1 is " << network.weight(0, 1) << " instead of " << source.weight(0, 1) << endl;
+        return 1;
+    }
+    if (std::isnan(network.weight(2, 3))) {
+        cerr << "A flag of 255 is not read as a connection" << endl;
+        return 1;
+    }
+    if (!std::isnan(network.weight(2, 4))) {
+        cerr << "A flag of 0 is read as a connection" << endl;
+        return 1;
+    }
+
+    cout << "Non-zero flags read as connections" << endl;
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "memory_ensemble.hpp"
+
+// Steps a MemoryEnsemble and as many separate MemoryNetwork with the same
+// stimuli, and checks that each member stays within rounding of its network.
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t MEMBERS = 5;
+const size_t UNITS = 150;
+
+const double MAX_DIVERGENCE = 1e-12;
+
+int main() {
+
+    vector<string> names;
+    for (size_t i = 0; i < UNITS; i++) names.push_back("unit" + to_string(i));
+
+    MemoryEnsemble ensemble(MEMBERS);
+    ensemble.add_units(names);
+
+    vector<MemoryNetwork> networks(MEMBERS);
+    for (auto& network : networks) {
+        network.use_physical_time(false);
+        network.max_frequency(10000);
+        network.add_units(names);
+    }
+
+    double activation_divergence = 0, weight_divergence = 0;
+
+    for (size_t t = 0; t < 40; t++) {
+
+        // the last member is never stimulated
+        for (size_t b = 0; b + 1 < MEMBERS; b++) {
+            for (size_t k = 0; k < 6; k++) {
+                auto id = (b * 11 + t * 5 + k * 17) % UNITS;
+                ensemble.activate_unit(b, id, 1.0, milliseconds(3));
+                networks[b].activate_unit(id, 1.0, milliseconds(3));
+            }
+        }
+
+        // 10ms, in a number of steps that is not a multiple of the period
+        ensemble.run_for(microseconds(9950));
+        for (auto& network : networks) network.step_n(100);
+
+        auto activations = ensemble.activations();
+        for (size_t b = 0; b < MEMBERS; b++) {
+            auto expected = networks[b].activations();
+            for (size_t i = 0; i < UNITS; i++) {
+                activation_divergence = max(activation_divergence, abs(activations(i, b) - expected(i)));
+            }
+        }
+    }
+
+    for (size_t b = 0; b < MEMBERS; b++) {
+        for (size_t i = 0; i < UNITS; i++) {
+            for (size_t j = 0; j < UNITS; j++) {
+                auto w = ensemble.weight(b, i, j);
+                auto expected = networks[b].weight(i, j);
+                if (std::isnan(w) != std::isnan(expected)) {
+                    cerr << "Member " << b << ": connection " << i << " - " << j << " differs" << endl;
+                    return 1;
+                }
+                if (!std::isnan(w)) weight_divergence = max(weight_divergence, abs(w - expected));
+            }
+        }
+    }
+
+    cout << "Divergence of the ensemble from separate networks: "
+         << activation_divergence << " (activations), "
+         << weight_divergence << " (weights)" << endl;
+
+    if (ensemble.elapsed_time() != networks[0].elapsed_time()) {
+        cerr << "The ensemble time (" << ensemble.elapsed_time().count() << "us) differs from the networks' ("
+             << networks[0].elapsed_time().count() << "us)" << endl;
+        return 1;
+    }
+
+    if (activation_divergence > MAX_DIVERGENCE || weight_divergence > MAX_DIVERGENCE) {
+        cerr << "The ensemble diverges from separate networks" << endl;
+        return 1;
+    }
+
+    try {
+        ensemble.snapshot(MEMBERS);
+        cerr << "Got a snapshot of a member out of the ensemble" << endl;
+        return 1;
+    } catch (const out_of_range&) {}
+
+    return 0;
+}
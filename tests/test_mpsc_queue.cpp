@@ -0,0 +1,62 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "mpsc_queue.hpp"
+
+// Several producers push numbered values through a small queue (often
+// full: they push again until accepted), while the consumer checks that
+// it receives every value of each producer, once and in order.
+
+using namespace std;
+
+const size_t PRODUCERS = 4;
+const size_t VALUES = 200000;
+const size_t CAPACITY = 64;
+
+struct Value {
+    size_t producer;
+    size_t index;
+};
+
+int main() {
+
+    MPSCQueue<Value> queue(CAPACITY);
+
+    vector<thread> producers;
+    for (size_t p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&queue, p]() {
+            for (size_t k = 0; k < VALUES; k++) {
+                while (!queue.push({p, k})) this_thread::yield();
+            }
+        });
+    }
+
+    vector<size_t> next(PRODUCERS, 0);
+    size_t nb_received = 0;
+    Value value;
+    while (nb_received < PRODUCERS * VALUES) {
+        if (!queue.pop(value)) {
+            this_thread::yield();
+            continue;
+        }
+        if (value.producer >= PRODUCERS || value.index != next[value.producer]) {
+            cerr << "Received value " << value.index << " of producer " << value.producer
+                 << " instead of " << next[value.producer] << endl;
+            return 1;
+        }
+        next[value.producer]++;
+        nb_received++;
+    }
+
+    for (auto& producer : producers) producer.join();
+
+    if (!queue.empty()) {
+        cerr << "The queue is not empty after all the values were received" << endl;
+        return 1;
+    }
+
+    cout << nb_received << " values received" << endl;
+
+    return 0;
+}
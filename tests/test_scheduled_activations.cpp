@@ -0,0 +1,54 @@
+#include <iostream>
+
+#include "memory_network.hpp"
+
+// Schedules a whole experiment upfront, with many more activations than the
+// activations queue can hold, and checks that each one is applied, on time.
+
+using namespace std;
+using namespace std::chrono;
+
+const size_t UNITS = 100;
+const size_t ACTIVATIONS = 10000;
+const microseconds PERIOD(100);
+
+int main() {
+
+    MemoryNetwork network;
+    network.use_physical_time(false);
+    network.max_frequency(1e6 / PERIOD.count());
+    network.record(true);
+
+    for (size_t i = 0; i < UNITS; i++) network.add_unit("unit" + to_string(i));
+
+    for (size_t k = 0; k < ACTIVATIONS; k++) {
+        network.schedule_activation(k % UNITS, 1.0, PERIOD / 2, microseconds(k * PERIOD.count()));
+    }
+
+    network.run_for(microseconds(ACTIVATIONS * PERIOD.count()) + milliseconds(10));
+
+    if (network.dropped_activations() > 0) {
+        cerr << network.dropped_activations() << " activations were dropped" << endl;
+        return 1;
+    }
+
+    size_t nb_applied = 0;
+    for (size_t id = 0; id < UNITS; id++) {
+        auto intervals = network.recorded_activations(id);
+        nb_applied += intervals.size();
+
+        // (the first step happens at time PERIOD)
+        for (size_t k = 0; k < intervals.size(); k++) {
+            auto expected = max(PERIOD, microseconds((k * UNITS + id) * PERIOD.count()));
+            if (intervals[k].start != expected) {
+                cerr << "Unit " << id << ": activation " << k << " applied at " << intervals[k].start.count()
+                     << "us instead of " << expected.count() << "us" << endl;
+                return 1;
+            }
+        }
+    }
+
+    cout << nb_applied << " activations applied, out of " << ACTIVATIONS << endl;
+
+    return nb_applied == ACTIVATIONS ? 0 : 1;
+}